@@ -3,6 +3,7 @@
 #  all its content and recreated.
 #
 #  Then runs a test command given in the variable 'cmd' in directory 'dir'.
+#  If the variable 'input' is set, that file is used as stdin of the command.
 #  Checks that the return code is the same as variable 'return_code'.
 #  Checks that there is nothing on stderr.
 #  If the variable 'cmd2' is set, the command will be run and checked in the
@@ -34,9 +35,14 @@ endif()
 message("Executing: ${cmd}")
 separate_arguments(cmd)
 
+if(input)
+    set(_input_file INPUT_FILE ${input})
+endif()
+
 execute_process(
     COMMAND ${cmd}
     WORKING_DIRECTORY ${dir}
+    ${_input_file}
     RESULT_VARIABLE result
     OUTPUT_FILE ${output}
     ERROR_VARIABLE stderr
@@ -22,6 +22,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "command_apply_changes.hpp"
 
+#include "compacting_loader.hpp"
 #include "exception.hpp"
 #include "util.hpp"
 
@@ -41,7 +42,6 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <osmium/osm/object_comparisons.hpp>
 #include <osmium/osm/types.hpp>
 #include <osmium/util/verbose_output.hpp>
-#include <osmium/visitor.hpp>
 
 #include <boost/program_options.hpp>
 
@@ -283,7 +283,7 @@ bool CommandApplyChanges::run() {
     m_vout << "Opening output file...\n";
     osmium::io::Writer writer{m_output_file, m_output_overwrite, m_fsync};
 
-    std::vector<osmium::memory::Buffer> changes;
+    CompactingLoader changes;
     osmium::ObjectPointerCollection objects;
 
     m_vout << "Reading change file contents...\n";
@@ -296,11 +296,13 @@ bool CommandApplyChanges::run() {
         const osmium::io::File file{change_file_name, m_change_file_format};
         osmium::io::Reader reader{file, osmium::osm_entity_bits::object};
         while (osmium::memory::Buffer buffer = reader.read()) {
-            osmium::apply(buffer, objects);
-            changes.push_back(std::move(buffer));
+            changes.add(buffer, [&](osmium::OSMObject& object) {
+                objects.osm_object(object);
+            });
         }
         reader.close();
     }
+    changes.report(m_vout);
 
     m_vout << "Opening input file...\n";
     osmium::io::ReaderWithProgressBar reader{display_progress(), m_input_file, osmium::osm_entity_bits::object};
@@ -353,7 +355,7 @@ bool CommandApplyChanges::run() {
         objects.sort(osmium::object_order_type_id_reverse_version{});
 
         if (m_locations_on_ways) {
-            apply_changes_and_write(objects, changes, reader, writer);
+            apply_changes_and_write(objects, changes.buffers(), reader, writer);
         } else {
             m_vout << "Applying changes and writing them to output...\n";
             const auto input = osmium::io::make_input_iterator_range<osmium::OSMObject>(reader);
@@ -23,29 +23,46 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "command_cat.hpp"
 
 #include "exception.hpp"
+#include "pbf_blob_reader.hpp"
 #include "util.hpp"
 
+#include <osmium/io/detail/read_write.hpp>
 #include <osmium/io/file.hpp>
+#include <osmium/io/file_format.hpp>
 #include <osmium/io/header.hpp>
 #include <osmium/memory/buffer.hpp>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/location.hpp>
 #include <osmium/osm/object.hpp>
+#include <osmium/osm/timestamp.hpp>
 #include <osmium/osm/types.hpp>
 #include <osmium/util/verbose_output.hpp>
 
+#include <protozero/pbf_writer.hpp>
+
 #include <boost/program_options.hpp>
 
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
 #include <string>
 #include <utility>
 #include <vector>
 
+#ifdef _WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
 bool CommandCat::setup(const std::vector<std::string>& arguments) {
     po::options_description opts_cmd{"COMMAND OPTIONS"};
     opts_cmd.add_options()
     ("object-type,t", po::value<std::vector<std::string>>(), "Read only objects of given type (node, way, relation, changeset)")
     ("clean,c", po::value<std::vector<std::string>>(), "Clean attribute (version, changeset, timestamp, uid, user)")
     ("buffer-data", "Buffer all data in memory before writing it out")
+    ("copy-blocks", "Copy PBF data blocks without decoding them")
     ;
 
     const po::options_description opts_common{add_common_options()};
@@ -84,6 +101,31 @@ bool CommandCat::setup(const std::vector<std::string>& arguments) {
         m_buffer_data = true;
     }
 
+    if (vm.count("copy-blocks")) {
+        m_copy_blocks = true;
+
+        if (m_buffer_data) {
+            throw argument_error{"Can not use --copy-blocks together with --buffer-data."};
+        }
+        if (vm.count("object-type")) {
+            throw argument_error{"Can not use --copy-blocks together with --object-type/-t."};
+        }
+        if (!m_clean.empty()) {
+            throw argument_error{"Can not use --copy-blocks together with --clean/-c."};
+        }
+        if (!m_output_headers.empty()) {
+            throw argument_error{"Can not use --copy-blocks together with --output-header."};
+        }
+        if (m_output_file.format() != osmium::io::file_format::pbf) {
+            throw argument_error{"The --copy-blocks option only works with PBF output."};
+        }
+        for (const auto& file : m_input_files) {
+            if (file.format() != osmium::io::file_format::pbf || file.filename().empty() || file.filename() == "-") {
+                throw argument_error{"The --copy-blocks option only works with PBF input files (not STDIN)."};
+            }
+        }
+    }
+
     return true;
 }
 
@@ -94,6 +136,7 @@ void CommandCat::show_arguments() {
     m_vout << "  other options:\n";
     show_object_types(m_vout);
     m_vout << "    attributes to clean: " << m_clean.to_string() << '\n';
+    m_vout << "    copy PBF blocks: " << yes_no(m_copy_blocks);
 }
 
 void CommandCat::copy(osmium::ProgressBar& progress_bar, osmium::io::Reader& reader, osmium::io::Writer& writer) const {
@@ -151,12 +194,200 @@ void report_filename(osmium::VerboseOutput* vout, const osmium::io::File& file,
     }
 }
 
+// Encode a length-prefixed OSMHeader blob with an uncompressed
+// HeaderBlock. See https://wiki.openstreetmap.org/wiki/PBF_Format for
+// the message definitions.
+std::string encode_header_blob(const osmium::io::Header& header) {
+    std::string header_block;
+    {
+        protozero::pbf_writer pbf_header_block{header_block};
+
+        const auto box = header.joined_boxes();
+        if (box.valid()) {
+            // HeaderBBox uses nanodegrees
+            constexpr const int64_t factor = 1000000000 / osmium::detail::coordinate_precision;
+            protozero::pbf_writer pbf_bbox{pbf_header_block, 1}; // bbox
+            pbf_bbox.add_sint64(1, factor * box.bottom_left().x()); // left
+            pbf_bbox.add_sint64(2, factor * box.top_right().x()); // right
+            pbf_bbox.add_sint64(3, factor * box.top_right().y()); // top
+            pbf_bbox.add_sint64(4, factor * box.bottom_left().y()); // bottom
+        }
+
+        pbf_header_block.add_string(4, "OsmSchema-V0.6"); // required_features
+        if (header.get("pbf_dense_nodes") == "true") {
+            pbf_header_block.add_string(4, "DenseNodes");
+        }
+        if (header.has_multiple_object_versions()) {
+            pbf_header_block.add_string(4, "HistoricalInformation");
+        }
+        if (header.get("pbf_add_locations_to_ways") == "true") {
+            pbf_header_block.add_string(4, "LocationsOnWays");
+        }
+
+        if (header.get("sorting") == "Type_then_ID") {
+            pbf_header_block.add_string(5, "Sort.Type_then_ID"); // optional_features
+        }
+        for (const auto& option : header) {
+            if (option.first.rfind("pbf_optional_feature_", 0) == 0) {
+                pbf_header_block.add_string(5, option.second);
+            }
+        }
+
+        pbf_header_block.add_string(16, header.get("generator")); // writingprogram
+
+        const auto timestamp = header.get("osmosis_replication_timestamp");
+        if (!timestamp.empty()) {
+            pbf_header_block.add_int64(32, static_cast<int64_t>(osmium::Timestamp{timestamp.c_str()}.seconds_since_epoch()));
+        }
+        const auto sequence_number = header.get("osmosis_replication_sequence_number");
+        if (!sequence_number.empty()) {
+            pbf_header_block.add_int64(33, std::strtoll(sequence_number.c_str(), nullptr, 10));
+        }
+        const auto base_url = header.get("osmosis_replication_base_url");
+        if (!base_url.empty()) {
+            pbf_header_block.add_string(34, base_url);
+        }
+    }
+
+    std::string blob;
+    {
+        protozero::pbf_writer pbf_blob{blob};
+        pbf_blob.add_bytes(1, header_block); // raw
+        pbf_blob.add_int32(2, static_cast<int32_t>(header_block.size())); // raw_size
+    }
+
+    std::string blob_header;
+    {
+        protozero::pbf_writer pbf_blob_header{blob_header};
+        pbf_blob_header.add_string(1, "OSMHeader"); // type
+        pbf_blob_header.add_int32(3, static_cast<int32_t>(blob.size())); // datasize
+    }
+
+    const auto size = static_cast<uint32_t>(blob_header.size());
+    std::string data;
+    data += static_cast<char>((size >> 24U) & 0xffU);
+    data += static_cast<char>((size >> 16U) & 0xffU);
+    data += static_cast<char>((size >>  8U) & 0xffU);
+    data += static_cast<char>( size         & 0xffU);
+    data += blob_header;
+    data += blob;
+
+    return data;
+}
+
+// Owns a file descriptor and closes it on destruction unless it was
+// closed explicitly with close(), which reports errors.
+class file_descriptor {
+
+    int m_fd;
+
+public:
+
+    explicit file_descriptor(int fd) noexcept :
+        m_fd(fd) {
+    }
+
+    file_descriptor(const file_descriptor&) = delete;
+    file_descriptor& operator=(const file_descriptor&) = delete;
+
+    file_descriptor(file_descriptor&&) = delete;
+    file_descriptor& operator=(file_descriptor&&) = delete;
+
+    ~file_descriptor() noexcept {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+
+    int get() const noexcept {
+        return m_fd;
+    }
+
+    void close() {
+        const int fd = m_fd;
+        m_fd = -1;
+        osmium::io::detail::reliable_close(fd);
+    }
+
+}; // class file_descriptor
+
 } // anonymous namespace
 
+std::size_t CommandCat::copy_blocks() {
+    // The required features of the output file are those of all input
+    // files together, the bounding box contains the bounding boxes of all
+    // input files. Like without --copy-blocks, the sorting and replication
+    // information is only kept if there is a single input file. Only the
+    // headers of the input files are read here.
+    osmium::io::Header header;
+    osmium::Box bounding_box;
+    for (const auto& input_file : m_input_files) {
+        osmium::io::Reader reader{input_file, osmium::osm_entity_bits::nothing};
+        const osmium::io::Header input_header{reader.header()};
+        reader.close();
+        if (m_input_files.size() == 1) {
+            header = input_header;
+        }
+        bounding_box.extend(input_header.joined_boxes());
+        if (input_header.get("pbf_dense_nodes") == "true") {
+            header.set("pbf_dense_nodes", true);
+        }
+        if (input_header.has_multiple_object_versions()) {
+            header.set_has_multiple_object_versions(true);
+        }
+        if (input_header.get("pbf_add_locations_to_ways") == "true") {
+            header.set("pbf_add_locations_to_ways", true);
+        }
+    }
+    setup_header(header);
+    if (m_input_files.size() > 1 && bounding_box.valid()) {
+        header.add_box(bounding_box);
+    }
+
+    file_descriptor fd{osmium::io::detail::open_for_writing(m_output_file.filename(), m_output_overwrite)};
+
+    std::size_t bytes_written = 0;
+    const auto write = [&](const std::string& data) {
+        osmium::io::detail::reliable_write(fd.get(), data.data(), data.size());
+        bytes_written += data.size();
+    };
+
+    write(encode_header_blob(header));
+
+    std::size_t blocks = 0;
+    osmium::ProgressBar progress_bar{file_size_sum(m_input_files), display_progress()};
+    for (const auto& input_file : m_input_files) {
+        progress_bar.remove();
+        m_vout << "Copying data blocks from input file '" << input_file.filename() << "'...\n";
+        PbfBlobReader blob_reader{input_file.filename()};
+        pbf_blob blob;
+        while (blob_reader.next(&blob)) {
+            if (blob.type == "OSMData") {
+                write(blob_reader.read_blob(blob));
+                ++blocks;
+            }
+            progress_bar.update(blob.end_offset());
+        }
+        progress_bar.file_done(blob_reader.file_size());
+    }
+    progress_bar.done();
+
+    if (m_fsync == osmium::io::fsync::yes) {
+        osmium::io::detail::reliable_fsync(fd.get());
+    }
+    fd.close();
+
+    m_vout << "Copied " << blocks << " data blocks.\n";
+
+    return bytes_written;
+}
+
 bool CommandCat::run() {
     std::size_t bytes_written = 0;
 
-    if (m_input_files.size() == 1) { // single input file
+    if (m_copy_blocks) {
+        bytes_written = copy_blocks();
+    } else if (m_input_files.size() == 1) { // single input file
         osmium::io::Reader reader{m_input_files[0], osm_entity_bits()};
         osmium::io::Header header{reader.header()};
 
@@ -35,6 +35,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 class CommandCat : public CommandWithMultipleOSMInputs, public with_osm_output {
 
     bool m_buffer_data = false;
+    bool m_copy_blocks = false;
 
     void copy(osmium::ProgressBar& progress_bar, osmium::io::Reader& reader, osmium::io::Writer& writer) const;
 
@@ -42,6 +43,8 @@ class CommandCat : public CommandWithMultipleOSMInputs, public with_osm_output {
 
     void write_buffers(osmium::ProgressBar& progress_bar, std::vector<osmium::memory::Buffer>& buffers, osmium::io::Writer& writer);
 
+    std::size_t copy_blocks();
+
 public:
     explicit CommandCat(const CommandFactory& command_factory) :
         CommandWithMultipleOSMInputs(command_factory) {
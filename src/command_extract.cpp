@@ -26,19 +26,25 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "extract/extract_bbox.hpp"
 #include "extract/extract_polygon.hpp"
+#include "extract/extract_state.hpp"
 #include "extract/geojson_file_parser.hpp"
+#include "extract/id_set.hpp"
+#include "extract/incremental_update.hpp"
 #include "extract/osm_file_parser.hpp"
 #include "extract/poly_file_parser.hpp"
+#include "extract/polygon_cache.hpp"
 #include "extract/strategy_complete_ways.hpp"
 #include "extract/strategy_complete_ways_with_history.hpp"
 #include "extract/strategy_simple.hpp"
 #include "extract/strategy_smart.hpp"
+#include "temp_file.hpp"
 #include "util.hpp"
 
 #include <osmium/geom/coordinates.hpp>
 #include <osmium/handler/check_order.hpp>
 #include <osmium/io/any_input.hpp>
 #include <osmium/io/header.hpp>
+#include <osmium/io/writer.hpp>
 #include <osmium/io/writer_options.hpp>
 #include <osmium/osm.hpp>
 #include <osmium/osm/box.hpp>
@@ -50,15 +56,20 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <boost/program_options.hpp>
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <system_error>
+#include <thread>
 #include <vector>
 
 #ifdef _WIN32
@@ -182,12 +193,8 @@ bool is_path_rooted(const std::string& path) noexcept {
 }
 #endif
 
-std::size_t parse_multipolygon_object(const std::string& directory, std::string file_name, std::string file_type, osmium::memory::Buffer* buffer) {
-    assert(buffer);
-
-    if (file_name.empty()) {
-        throw config_error{"Missing 'file_name' in '(multi)polygon' object."};
-    }
+std::string polygon_file_path(const std::string& directory, const std::string& file_name) {
+    assert(!file_name.empty());
 
 #ifdef _WIN32
     const bool is_relative = !is_path_rooted(file_name);
@@ -197,9 +204,21 @@ std::size_t parse_multipolygon_object(const std::string& directory, std::string
 
     if (is_relative) {
         // relative file name
-        file_name = directory + file_name;
+        return directory + file_name;
+    }
+
+    return file_name;
+}
+
+std::size_t parse_multipolygon_object(const std::string& directory, std::string file_name, std::string file_type, osmium::memory::Buffer* buffer) {
+    assert(buffer);
+
+    if (file_name.empty()) {
+        throw config_error{"Missing 'file_name' in '(multi)polygon' object."};
     }
 
+    file_name = polygon_file_path(directory, file_name);
+
     // If the file type is not set, try to deduce it from the file name
     // suffix.
     if (file_type.empty()) {
@@ -280,6 +299,43 @@ std::size_t parse_multipolygon(const std::string& directory, const nlohmann::jso
     throw config_error{"Multipolygon must be an object or array."};
 }
 
+// Calculate the key for the polygon cache from the contents of the config
+// file and all polygon files referenced in it. Files that can't be read
+// are ignored here, reading them will fail later anyway.
+uint64_t polygon_cache_key(const std::string& config, const nlohmann::json& doc, const std::string& directory) {
+    PolygonCacheKey key;
+    key.add(config);
+
+    const auto json_extracts = doc.find("extracts");
+    if (json_extracts == doc.end() || !json_extracts->is_array()) {
+        return key.value();
+    }
+
+    for (const auto& item : *json_extracts) {
+        if (!item.is_object()) {
+            continue;
+        }
+        for (const char* geometry : {"polygon", "multipolygon"}) {
+            const auto json_geometry = item.find(geometry);
+            if (json_geometry == item.end() || !json_geometry->is_object()) {
+                continue;
+            }
+            const auto json_file_name = json_geometry->find("file_name");
+            if (json_file_name == json_geometry->end() || !json_file_name->is_string()) {
+                continue;
+            }
+            const auto file_name = json_file_name->template get<std::string>();
+            if (file_name.empty()) {
+                continue;
+            }
+            std::ifstream file{polygon_file_path(directory, file_name), std::ios::binary};
+            key.add(std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}});
+        }
+    }
+
+    return key.value();
+}
+
 bool is_existing_directory(const char* name) {
 #ifdef _MSC_VER
     // Windows implementation
@@ -312,13 +368,39 @@ void CommandExtract::set_directory(const std::string& directory) {
 }
 
 void CommandExtract::parse_config_file() {
-    std::ifstream config_file{m_config_file_name};
-    nlohmann::json doc = nlohmann::json::parse(config_file);
+    std::ifstream config_file{m_config_file_name, std::ios::binary};
+    const std::string config{std::istreambuf_iterator<char>{config_file}, std::istreambuf_iterator<char>{}};
+    nlohmann::json doc = nlohmann::json::parse(config);
 
     if (!doc.is_object()) {
         throw config_error{"Top-level value must be an object."};
     }
 
+    std::unique_ptr<PolygonCache> polygon_cache;
+    if (!m_polygon_cache_file_name.empty()) {
+        polygon_cache = std::make_unique<PolygonCache>(m_polygon_cache_file_name, polygon_cache_key(config, doc, m_config_directory));
+        if (polygon_cache->load(&m_buffer)) {
+            m_vout << "  Using polygons from cache file '" << m_polygon_cache_file_name << "'.\n";
+        } else {
+            m_vout << "  Polygon cache file '" << m_polygon_cache_file_name << "' missing or out of date.\n";
+        }
+    }
+
+    const auto make_polygon_extract = [&](const osmium::io::File& output_file, const std::string& description, const nlohmann::json& value, bool multi, int raster_size) {
+        if (polygon_cache && polygon_cache->loaded()) {
+            auto& entry = polygon_cache->next();
+            return std::make_unique<ExtractPolygon>(output_file, description, m_buffer, entry.offset, std::move(entry.parts));
+        }
+
+        const auto offset = multi ? parse_multipolygon(m_config_directory, value, &m_buffer)
+                                  : parse_polygon(m_config_directory, value, &m_buffer);
+        auto extract = std::make_unique<ExtractPolygon>(output_file, description, m_buffer, offset, raster_size);
+        if (polygon_cache) {
+            polygon_cache->add(offset, extract->prepared());
+        }
+        return extract;
+    };
+
     const std::string directory{get_value_as_string(doc, "directory")};
     if (!directory.empty() && m_output_directory.empty()) {
         m_vout << "  Directory set to '" << directory << "'.\n";
@@ -364,16 +446,44 @@ void CommandExtract::parse_config_file() {
                 throw config_error{"Looks like you are trying to write a history file, but option --with-history is not set."};
             }
 
+            int raster_size = ExtractPolygon::raster_size_auto;
+            const auto json_raster_size = item.find("raster_size");
+            if (json_raster_size != item.end()) {
+                if (!json_raster_size->is_number_unsigned() ||
+                    json_raster_size->template get<std::size_t>() > ExtractPolygon::max_raster_size) {
+                    throw config_error{"Optional 'raster_size' field must be a number between 0 and " + std::to_string(ExtractPolygon::max_raster_size) + "."};
+                }
+                raster_size = json_raster_size->template get<int>();
+            }
+
             if (json_bbox != item.end()) {
                 m_extracts.push_back(std::make_unique<ExtractBBox>(output_file, description, parse_bbox(*json_bbox)));
             } else if (json_polygon != item.end()) {
-                m_extracts.push_back(std::make_unique<ExtractPolygon>(output_file, description, m_buffer, parse_polygon(m_config_directory, *json_polygon, &m_buffer)));
+                m_extracts.push_back(make_polygon_extract(output_file, description, *json_polygon, false, raster_size));
             } else if (json_multipolygon != item.end()) {
-                m_extracts.push_back(std::make_unique<ExtractPolygon>(output_file, description, m_buffer, parse_multipolygon(m_config_directory, *json_multipolygon, &m_buffer)));
+                m_extracts.push_back(make_polygon_extract(output_file, description, *json_multipolygon, true, raster_size));
             } else {
                 throw config_error{"Missing geometry for extract. Need 'bbox', 'polygon', or 'multipolygon'."};
             }
 
+            const std::string parent{get_value_as_string(item, "parent")};
+            if (!parent.empty()) {
+                Extract& extract = *m_extracts.back();
+                const auto last = std::prev(m_extracts.end());
+                const auto it = std::find_if(m_extracts.begin(), last, [&](const std::unique_ptr<Extract>& e) {
+                    return e->output() == m_output_directory + parent;
+                });
+                if (it == last) {
+                    throw config_error{"Parent extract '" + parent + "' not found. It must be defined before this extract."};
+                }
+                const osmium::Box& parent_envelope = (*it)->envelope();
+                if (!parent_envelope.contains(extract.envelope().bottom_left()) ||
+                    !parent_envelope.contains(extract.envelope().top_right())) {
+                    throw config_error{"Envelope of extract must be inside envelope of parent extract '" + parent + "'."};
+                }
+                extract.set_parent(static_cast<std::size_t>(std::distance(m_extracts.begin(), it)));
+            }
+
             const auto json_output_header = item.find("output_header");
             if (json_output_header != item.end()) {
                 if (!json_output_header->is_object()) {
@@ -416,6 +526,14 @@ void CommandExtract::parse_config_file() {
 
         ++extract_num;
     }
+
+    if (polygon_cache && !polygon_cache->loaded()) {
+        m_vout << "  Writing polygon cache file '" << m_polygon_cache_file_name << "'...\n";
+        if (!polygon_cache->save(m_buffer)) {
+            m_vout << "  Could not write polygon cache file. Ignoring it.\n";
+        }
+    }
+
     m_vout << '\n';
 }
 
@@ -448,13 +566,22 @@ bool CommandExtract::setup(const std::vector<std::string>& arguments) {
     po::options_description opts_cmd{"COMMAND OPTIONS"};
     opts_cmd.add_options()
     ("bbox,b", po::value<std::string>(), "Bounding box")
+    ("buffer-memory", po::value<std::size_t>(), "Memory for output buffers of all extracts in MBytes (default: 1024)")
+    ("buffer-size", po::value<std::size_t>(), "Largest size of the output buffer of each extract in kBytes (default: 10240)")
     ("config,c", po::value<std::string>(), "Config file")
     ("directory,d", po::value<std::string>(), "Output directory (default: from config)")
+    ("from-state", po::value<std::string>(), "Create change files for extracts from change file using state file")
     ("option,S", po::value<std::vector<std::string>>(), "Set strategy option")
     ("polygon,p", po::value<std::string>(), "Polygon file")
+    ("polygon-cache", po::value<std::string>(), "Cache file for prepared polygons from config file")
     ("strategy,s", po::value<std::string>()->default_value("complete_ways"), "Use named extract strategy")
+    ("threads", po::value<unsigned int>(), "Number of threads used for checking extracts (0: all cores, default: 1)")
     ("with-history,H", "Input file and output files are history files")
+    ("save-state", po::value<std::string>(), "Write state of extracts to file for later updates")
     ("set-bounds", "Sets bounds (bounding box) in header")
+    ("spool-stdin", "Copy input from STDIN to a temporary file if the strategy needs several passes")
+    ("tmp-dir", po::value<std::string>(), "Directory for temporary files (default: $TMPDIR or /tmp)")
+    ("writer-threads", po::value<unsigned int>(), "Number of threads shared by all extracts for encoding output (default: libosmium pool)")
     ("clean", po::value<std::vector<std::string>>(), "Clean attribute (version, changeset, timestamp, uid, user)")
     ;
 
@@ -507,6 +634,9 @@ bool CommandExtract::setup(const std::vector<std::string>& arguments) {
         if (vm.count("output-format")) {
             warning("Ignoring --output-format/-f option.\n");
         }
+        if (vm.count("polygon-cache")) {
+            m_polygon_cache_file_name = vm["polygon-cache"].as<std::string>();
+        }
         m_config_file_name = vm["config"].as<std::string>();
         const auto slash = m_config_file_name.find_last_of('/');
         if (slash != std::string::npos) {
@@ -515,6 +645,10 @@ bool CommandExtract::setup(const std::vector<std::string>& arguments) {
         }
     }
 
+    if (!vm.count("config") && vm.count("polygon-cache")) {
+        warning("Ignoring --polygon-cache option.\n");
+    }
+
     if (vm.count("bbox")) {
         if (vm.count("directory")) {
             warning("Ignoring --directory/-d option.\n");
@@ -537,6 +671,20 @@ bool CommandExtract::setup(const std::vector<std::string>& arguments) {
         m_extracts.push_back(std::make_unique<ExtractPolygon>(m_output_file, "", m_buffer, parse_multipolygon_object("./", vm["polygon"].as<std::string>(), "", &m_buffer)));
     }
 
+    if (vm.count("from-state")) {
+        if (m_with_history) {
+            throw argument_error{"The --from-state option can not be used with history files."};
+        }
+        if (!m_input_file.is_change()) {
+            throw argument_error{"The input file must be a change file when using the --from-state option."};
+        }
+        m_from_state_file_name = vm["from-state"].as<std::string>();
+    }
+
+    if (vm.count("save-state")) {
+        m_save_state_file_name = vm["save-state"].as<std::string>();
+    }
+
     if (vm.count("option")) {
         for (const auto& option : vm["option"].as<std::vector<std::string>>()) {
             m_options.set(option);
@@ -547,10 +695,48 @@ bool CommandExtract::setup(const std::vector<std::string>& arguments) {
         m_set_bounds = true;
     }
 
+    if (vm.count("spool-stdin")) {
+        m_spool_stdin = true;
+    }
+
+    if (vm.count("buffer-memory")) {
+        m_buffer_memory = vm["buffer-memory"].as<std::size_t>();
+        if (m_buffer_memory == 0) {
+            throw argument_error{"The --buffer-memory option must be at least 1."};
+        }
+    }
+
+    if (vm.count("buffer-size")) {
+        m_buffer_size = vm["buffer-size"].as<std::size_t>();
+        if (m_buffer_size < Extract::min_buffer_size / 1024) {
+            throw argument_error{"The --buffer-size option must be at least " + std::to_string(Extract::min_buffer_size / 1024) + "."};
+        }
+    }
+
+    if (vm.count("writer-threads")) {
+        m_writer_threads = vm["writer-threads"].as<unsigned int>();
+        if (m_writer_threads == 0) {
+            throw argument_error{"The --writer-threads option must be at least 1."};
+        }
+    }
+
+    if (vm.count("tmp-dir")) {
+        m_tmp_dir = vm["tmp-dir"].as<std::string>();
+    } else {
+        m_tmp_dir = default_tmp_dir();
+    }
+
     if (vm.count("strategy")) {
         m_strategy_name = vm["strategy"].as<std::string>();
     }
 
+    if (vm.count("threads")) {
+        m_num_threads = vm["threads"].as<unsigned int>();
+        if (m_num_threads == 0) {
+            m_num_threads = std::max(std::thread::hardware_concurrency(), 1U);
+        }
+    }
+
     return true;
 }
 
@@ -561,9 +747,24 @@ void CommandExtract::show_arguments() {
     m_vout << "  strategy options:\n";
     m_vout << "    strategy: " << m_strategy_name << '\n';
     m_vout << "    with history: " << yes_no(m_with_history);
+    m_vout << "    threads: " << m_num_threads << '\n';
+    m_vout << "    memory for output buffers: " << m_buffer_memory << " MBytes\n";
+    m_vout << "    largest output buffer size per extract: " << m_buffer_size << " kBytes\n";
+    if (m_writer_threads > 0) {
+        m_vout << "    writer threads: " << m_writer_threads << '\n';
+    } else {
+        m_vout << "    writer threads: (libosmium default pool)\n";
+    }
+    m_vout << "    spool STDIN: " << yes_no(m_spool_stdin);
+    if (m_spool_stdin) {
+        m_vout << "    directory for temporary files: " << m_tmp_dir << '\n';
+    }
 
     m_vout << "  other options:\n";
     m_vout << "    config file: " << m_config_file_name << '\n';
+    m_vout << "    polygon cache file: " << m_polygon_cache_file_name << '\n';
+    m_vout << "    read state from: " << m_from_state_file_name << '\n';
+    m_vout << "    save state to: " << m_save_state_file_name << '\n';
     m_vout << "    output directory: " << m_output_directory << '\n';
     m_vout << "    attributes to clean: " << m_clean.to_string() << '\n';
 
@@ -581,6 +782,9 @@ void CommandExtract::show_extracts() {
         std::cerr.fill(old_fill);
         m_vout << "     Format:      " << e->output_format()    << '\n';
         m_vout << "     Description: " << e->description()      << '\n';
+        if (e->parent() != Extract::no_parent) {
+            m_vout << "     Parent:      " << m_extracts[e->parent()]->output() << '\n';
+        }
         if (!e->header_options().empty()) {
             m_vout << "     Header opts: ";
             bool first = true;
@@ -602,6 +806,51 @@ void CommandExtract::show_extracts() {
     m_vout << '\n';
 }
 
+void CommandExtract::load_states() {
+    m_vout << "Reading state file '" << m_from_state_file_name << "'...\n";
+    auto states = read_state_file(m_from_state_file_name);
+    if (states.size() != m_extracts.size()) {
+        throw argument_error{"State file '" + m_from_state_file_name + "' is for " + std::to_string(states.size()) +
+                             " extracts, but there are " + std::to_string(m_extracts.size()) + "."};
+    }
+
+    for (std::size_t n = 0; n < m_extracts.size(); ++n) {
+        if (!m_extracts[n]->output_is_change()) {
+            throw argument_error{"Output file '" + m_extracts[n]->output() + "' must be a change file when using the --from-state option."};
+        }
+        m_extracts[n]->set_state(std::move(states[n]));
+    }
+}
+
+osmium::io::File CommandExtract::spool_input(const TempFile& temp_file) {
+    m_vout << "Copying input from STDIN to temporary file '" << temp_file.path() << "'...\n";
+
+    // The writer and the strategy open the file again by name. The file
+    // was created exclusively by TempFile, make sure it wasn't replaced
+    // by something else in the meantime.
+    const auto check_file = [&temp_file]() {
+        if (!temp_file.unchanged()) {
+            throw std::runtime_error{"Temporary file '" + temp_file.path() + "' was replaced."};
+        }
+    };
+
+    osmium::io::Reader reader{m_input_file};
+    osmium::io::File file{temp_file.path(), "pbf"};
+    if (m_with_history) {
+        file.set_has_multiple_object_versions(true);
+    }
+    check_file();
+    osmium::io::Writer writer{file, reader.header(), osmium::io::overwrite::allow};
+    while (osmium::memory::Buffer buffer = reader.read()) {
+        writer(std::move(buffer));
+    }
+    writer.close();
+    reader.close();
+    check_file();
+
+    return file;
+}
+
 bool CommandExtract::run() {
     if (!m_config_file_name.empty()) {
         m_vout << "Reading config file...\n";
@@ -627,15 +876,57 @@ bool CommandExtract::run() {
 
     show_extracts();
 
-    m_strategy = make_strategy(m_strategy_name);
-    m_strategy->show_arguments(m_vout);
+    if (!m_from_state_file_name.empty()) {
+        load_states();
+    } else {
+        m_strategy = make_strategy(m_strategy_name);
+        m_strategy->set_tmp_dir(m_tmp_dir);
+        if (m_num_threads > 1) {
+            if (m_with_history) {
+                warning("Ignoring --threads option for history files.\n");
+            } else {
+                m_strategy->set_num_threads(m_num_threads);
+            }
+        }
+        if (m_extracts.size() > 1) {
+            std::vector<std::vector<osmium::Box>> envelopes;
+            envelopes.reserve(m_extracts.size());
+            for (const auto& extract : m_extracts) {
+                envelopes.push_back(extract->envelopes());
+            }
+            m_envelope_index = std::make_unique<EnvelopeIndex>(envelopes);
+            m_strategy->set_envelope_index(m_envelope_index.get());
+            m_vout << "Envelope index built with " << m_envelope_index->size() << " entries.\n";
+        }
+        m_strategy->show_arguments(m_vout);
+
+        const auto compressed_id_sets = std::count_if(m_extracts.begin(), m_extracts.end(), [&](const std::unique_ptr<Extract>& extract) {
+            return m_strategy->id_set_type_for(extract->envelope()) == id_set_type::compressed;
+        });
+        m_vout << "Using compressed ID sets for " << compressed_id_sets << " of " << m_extracts.size() << " extracts.\n";
+
+        if (!m_save_state_file_name.empty()) {
+            for (const auto& extract : m_extracts) {
+                extract->set_state(std::make_unique<ExtractState>());
+            }
+        }
+    }
+
+    // Strategies with several passes can't read from STDIN, so the input
+    // is copied into a temporary file first if the user asked for that.
+    osmium::io::File input_file{m_input_file};
+    std::unique_ptr<TempFile> spool_file;
+    if (m_spool_stdin && m_input_file.filename().empty() && m_strategy && m_strategy->needs_multiple_passes()) {
+        spool_file = std::make_unique<TempFile>(m_tmp_dir, ".osm.pbf");
+        input_file = spool_input(*spool_file);
+    }
 
     osmium::io::Header header;
     osmium::io::Header input_header;
-    if (m_input_file.filename().empty()) {
+    if (input_file.filename().empty()) {
         setup_header(header);
     } else {
-        osmium::io::Reader reader{m_input_file, osmium::osm_entity_bits::nothing};
+        osmium::io::Reader reader{input_file, osmium::osm_entity_bits::nothing};
         input_header = reader.header();
         setup_header(header, input_header);
         reader.close();
@@ -645,20 +936,51 @@ bool CommandExtract::run() {
         header.set_has_multiple_object_versions(true);
     }
 
+    // The buffers are only allocated when data is written to an extract.
+    // They start small and only get larger if the budget allows it. The
+    // budget also covers the buffers in the output queues of the writers.
+    m_buffer_budget = std::make_unique<BufferBudget>(m_buffer_memory * 1024UL * 1024UL, BufferBudget::writer_queue_size());
+    for (const auto& extract : m_extracts) {
+        extract->set_buffer_size(m_buffer_size * 1024UL);
+        extract->set_buffer_budget(m_buffer_budget.get());
+    }
+    m_vout << "Memory for output buffers: " << m_buffer_memory << " MBytes (writer queue size " << m_buffer_budget->queue_size()
+           << ", at least " << (m_buffer_budget->memory_for(Extract::min_buffer_size) / 1024) << " kBytes per extract with data)\n";
+
+    if (m_writer_threads > 0) {
+        m_writer_pool = std::make_unique<osmium::thread::Pool>(static_cast<int>(m_writer_threads));
+    }
+
     for (const auto& extract : m_extracts) {
         osmium::io::Header file_header{header};
         if (m_set_bounds) {
             file_header.add_box(extract->envelope());
         }
         init_header(file_header, input_header, extract->header_options());
-        extract->open_file(file_header, m_output_overwrite, m_fsync, &m_clean);
+        extract->open_file(file_header, m_output_overwrite, m_fsync, &m_clean, m_writer_pool.get());
     }
 
-    m_strategy->run(m_vout, display_progress(), m_input_file);
+    if (m_from_state_file_name.empty()) {
+        m_strategy->run(m_vout, display_progress(), input_file);
+    } else {
+        IncrementalUpdate update{m_extracts, m_strategy_name != "simple"};
+        update.run(m_vout, m_input_file);
+    }
 
     for (const auto& extract : m_extracts) {
         extract->close_file();
     }
+    m_vout << "Peak memory for output buffers: " << show_mbytes(m_buffer_budget->peak()) << " MBytes\n";
+
+    if (!m_save_state_file_name.empty()) {
+        m_vout << "Writing state file '" << m_save_state_file_name << "'...\n";
+        std::vector<const ExtractState*> states;
+        states.reserve(m_extracts.size());
+        for (const auto& extract : m_extracts) {
+            states.push_back(extract->state());
+        }
+        write_state_file(m_save_state_file_name, states);
+    }
 
     show_memory_used();
 
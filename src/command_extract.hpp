@@ -24,10 +24,14 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include "cmd.hpp" // IWYU pragma: export
+#include "extract/buffer_budget.hpp"
+#include "extract/envelope_index.hpp"
 #include "extract/extract.hpp"
 #include "extract/strategy.hpp"
+#include "temp_file.hpp"
 
 #include <osmium/memory/buffer.hpp>
+#include <osmium/thread/pool.hpp>
 #include <osmium/util/options.hpp>
 
 #include <cstddef>
@@ -39,19 +43,35 @@ class CommandExtract : public CommandWithSingleOSMInput, public with_osm_output
 
     static const std::size_t initial_buffer_size = 10 * 1024;
 
+    // Must be destroyed after the extracts, their writers might use it.
+    std::unique_ptr<osmium::thread::Pool> m_writer_pool;
+    std::unique_ptr<BufferBudget> m_buffer_budget;
+
     std::vector<std::unique_ptr<Extract>> m_extracts;
     osmium::Options m_options;
     std::string m_config_file_name;
     std::string m_config_directory;
+    std::string m_polygon_cache_file_name;
+    std::string m_from_state_file_name;
+    std::string m_save_state_file_name;
+    std::string m_tmp_dir;
     std::string m_output_directory;
     std::string m_strategy_name;
     osmium::memory::Buffer m_buffer{initial_buffer_size, osmium::memory::Buffer::auto_grow::yes};
     std::unique_ptr<ExtractStrategy> m_strategy;
+    std::unique_ptr<EnvelopeIndex> m_envelope_index;
+    unsigned int m_num_threads = 1;
+    unsigned int m_writer_threads = 0;
+    std::size_t m_buffer_memory = 1024;
+    std::size_t m_buffer_size = Extract::default_buffer_size / 1024;
     bool m_with_history = false;
     bool m_set_bounds = false;
+    bool m_spool_stdin = false;
 
     void parse_config_file();
     void show_extracts();
+    void load_states();
+    osmium::io::File spool_input(const TempFile& temp_file);
 
     void set_directory(const std::string& directory);
 
@@ -23,16 +23,17 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "command_merge.hpp"
 
 #include "exception.hpp"
+#include "sort/loser_tree.hpp"
 #include "util.hpp"
 
 #include <osmium/io/file.hpp>
 #include <osmium/io/header.hpp>
-#include <osmium/io/input_iterator.hpp>
 #include <osmium/io/output_iterator.hpp>
 #include <osmium/io/reader.hpp>
 #include <osmium/io/reader_with_progress_bar.hpp>
 #include <osmium/io/writer.hpp>
 #include <osmium/memory/buffer.hpp>
+#include <osmium/memory/item_iterator.hpp>
 #include <osmium/osm/entity_bits.hpp>
 #include <osmium/osm/object.hpp>
 #include <osmium/osm/object_comparisons.hpp>
@@ -44,7 +45,6 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <iostream>
 #include <memory>
 #include <numeric>
-#include <queue>
 #include <string>
 #include <utility>
 #include <vector>
@@ -100,67 +100,55 @@ namespace {
 
     class DataSource {
 
-        using it_type = osmium::io::InputIterator<osmium::io::Reader, osmium::OSMObject>;
+        using iterator = osmium::memory::ItemIterator<osmium::OSMObject>;
 
         std::unique_ptr<osmium::io::Reader> m_reader;
         std::string m_name;
-        it_type m_iterator;
-
-        osmium::item_type m_last_type = osmium::item_type::node;
+        osmium::memory::Buffer m_buffer;
+        iterator m_begin;
+        iterator m_it;
+        iterator m_end;
+        const osmium::OSMObject* m_back = nullptr;
+        std::size_t m_buffer_count = 0;
+
+        osmium::item_type m_last_type = osmium::item_type::undefined;
         osmium::object_id_type m_last_id = 0;
         osmium::object_version_type m_last_version = 0;
 
         bool m_warning;
 
-    public:
-
-        explicit DataSource(const osmium::io::File& file, bool with_history) :
-            m_reader(std::make_unique<osmium::io::Reader>(file)),
-            m_name(file.filename()),
-            m_iterator(*m_reader),
-            m_warning(!with_history) {
-            if (m_iterator != it_type{}) {
-                m_last_type = m_iterator->type();
-                m_last_id = m_iterator->id();
-                m_last_version = m_iterator->version();
+        void check_order(const osmium::OSMObject& object) {
+            if (m_last_type == osmium::item_type::undefined) { // first object in file
+                m_last_type = object.type();
+                m_last_id = object.id();
+                m_last_version = object.version();
+                return;
             }
-        }
 
-        bool empty() const noexcept {
-            return m_iterator == it_type{};
-        }
-
-        bool next() {
-            ++m_iterator;
-
-            if (m_iterator == it_type{}) { // reached end of file
-                return false;
-            }
-
-            if (m_iterator->type() < m_last_type) {
+            if (object.type() < m_last_type) {
                 throw std::runtime_error{"Objects in input file '" + m_name + "' out of order (must be nodes, then ways, then relations)."};
             }
-            if (m_iterator->type() > m_last_type) {
-                m_last_type = m_iterator->type();
-                m_last_id = m_iterator->id();
-                m_last_version = m_iterator->version();
-                return true;
+            if (object.type() > m_last_type) {
+                m_last_type = object.type();
+                m_last_id = object.id();
+                m_last_version = object.version();
+                return;
             }
 
             static constexpr osmium::id_order id_cmp{};
-            if (id_cmp(m_iterator->id(), m_last_id)) {
+            if (id_cmp(object.id(), m_last_id)) {
                 throw std::runtime_error{"Objects in input file '" + m_name + "' out of order (smaller ids must come first)."};
             }
-            if (id_cmp(m_last_id, m_iterator->id())) {
-                m_last_id = m_iterator->id();
-                m_last_version = m_iterator->version();
-                return true;
+            if (id_cmp(m_last_id, object.id())) {
+                m_last_id = object.id();
+                m_last_version = object.version();
+                return;
             }
 
-            if (m_iterator->version() < m_last_version) {
+            if (object.version() < m_last_version) {
                 throw std::runtime_error{"Objects in input file '" + m_name + "' out of order (smaller version must come first)."};
             }
-            if (m_iterator->version() == m_last_version) {
+            if (object.version() == m_last_version) {
                 throw std::runtime_error{"Two objects in input file '" + m_name + "' with same version."};
             }
 
@@ -170,54 +158,89 @@ namespace {
                 m_warning = false;
             }
 
-            m_last_version = m_iterator->version();
-
-            return true;
-        }
-
-        const osmium::OSMObject* get() noexcept {
-            return &*m_iterator;
+            m_last_version = object.version();
         }
 
-        std::size_t offset() const noexcept {
-            return m_reader->offset();
+        // Get the next buffer with objects from the reader and check the
+        // order of all objects in it. The reader decodes the data in the
+        // background, so the next buffers are usually ready when they are
+        // needed.
+        bool next_buffer() {
+            while ((m_buffer = m_reader->read())) {
+                ++m_buffer_count;
+                auto objects = m_buffer.select<osmium::OSMObject>();
+                m_begin = m_it = objects.begin();
+                m_end = objects.end();
+                if (m_it != m_end) {
+                    for (const auto& object : objects) {
+                        check_order(object);
+                        m_back = &object;
+                    }
+                    return true;
+                }
+            }
+            m_begin = m_it = m_end = iterator{};
+            m_back = nullptr;
+            return false;
         }
 
-    }; // DataSource
-
-    class QueueElement {
+    public:
 
-        const osmium::OSMObject* m_object;
-        int m_data_source_index;
+        explicit DataSource(const osmium::io::File& file, bool with_history) :
+            m_reader(std::make_unique<osmium::io::Reader>(file, osmium::osm_entity_bits::object)),
+            m_name(file.filename()),
+            m_warning(!with_history) {
+            next_buffer();
+        }
 
-    public:
+        bool empty() const noexcept {
+            return m_it == m_end;
+        }
 
-        QueueElement(const osmium::OSMObject* object, int data_source_index) noexcept :
-            m_object(object),
-            m_data_source_index(data_source_index) {
+        bool next() {
+            ++m_it;
+            if (m_it == m_end) {
+                return next_buffer();
+            }
+            return true;
         }
 
-        const osmium::OSMObject& object() const noexcept {
-            return *m_object;
+        const osmium::OSMObject* get() noexcept {
+            return &*m_it;
         }
 
-        int data_source_index() const noexcept {
-            return m_data_source_index;
+        /// Number of buffers read so far.
+        std::size_t buffer_count() const noexcept {
+            return m_buffer_count;
         }
 
-    }; // QueueElement
+        /// The last object in the current buffer.
+        const osmium::OSMObject* back() const noexcept {
+            return m_back;
+        }
 
-    bool operator<(const QueueElement& lhs, const QueueElement& rhs) noexcept {
-        return lhs.object() > rhs.object();
-    }
+        /**
+         * Write all remaining objects from the current buffer and go on
+         * to the next buffer. If nothing was taken from the current
+         * buffer yet, it is handed to the writer as a whole.
+         */
+        template <typename TWriter>
+        void write_rest_of_buffer(TWriter& writer) {
+            if (m_it == m_begin) {
+                writer(std::move(m_buffer));
+            } else {
+                for (; m_it != m_end; ++m_it) {
+                    writer(*m_it);
+                }
+            }
+            next_buffer();
+        }
 
-    bool operator==(const QueueElement& lhs, const QueueElement& rhs) noexcept {
-        return lhs.object() == rhs.object();
-    }
+        std::size_t offset() const noexcept {
+            return m_reader->offset();
+        }
 
-    bool operator!=(const QueueElement& lhs, const QueueElement& rhs) noexcept {
-        return !(lhs == rhs);
-    }
+    }; // DataSource
 
 } // anonymous namespace
 
@@ -240,38 +263,64 @@ bool CommandMerge::run() {
         std::vector<DataSource> data_sources;
         data_sources.reserve(m_input_files.size());
 
-        std::priority_queue<QueueElement> queue;
-
-        int index = 0;
         for (const osmium::io::File& file : m_input_files) {
             data_sources.emplace_back(file, m_with_history);
-
-            if (!data_sources.back().empty()) {
-                queue.emplace(data_sources.back().get(), index);
-            }
-
-            ++index;
         }
 
-        int n = 0;
-        while (!queue.empty()) {
-            const auto element = queue.top();
-            queue.pop();
-            if (queue.empty() || element != queue.top()) {
-                writer(element.object());
-            }
+        // Type, ID, and version of the last object written. If the same
+        // object is in several input files, only the first one is written.
+        osmium::item_type last_type = osmium::item_type::undefined;
+        osmium::object_id_type last_id = 0;
+        osmium::object_version_type last_version = 0;
 
-            const int dsindex = element.data_source_index();
-            if (data_sources[dsindex].next()) {
-                queue.emplace(data_sources[dsindex].get(), dsindex);
-            }
+        LoserTree<DataSource> tree{data_sources};
 
+        // If all remaining objects in the buffer of the winning source
+        // come before the head of any other source, the whole rest of
+        // the buffer can be written without merging object by object.
+        // This is checked whenever another source takes the lead and
+        // whenever a source starts on a new buffer.
+        static constexpr osmium::object_order_type_id_version order{};
+        std::size_t last_winner = data_sources.size();
+        std::size_t last_buffer_count = 0;
+
+        int n = 0;
+        while (!tree.empty()) {
             if (n++ > 10000) {
                 n = 0;
                 progress_bar.update(std::accumulate(data_sources.cbegin(), data_sources.cend(), static_cast<std::size_t>(0), [](std::size_t sum, const DataSource& source){
                     return sum + source.offset();
                 }));
             }
+
+            auto& source = data_sources[tree.winner()];
+            const osmium::OSMObject& object = *source.get();
+            const bool duplicate = object.type() == last_type && object.id() == last_id && object.version() == last_version;
+
+            if (!duplicate && (tree.winner() != last_winner || source.buffer_count() != last_buffer_count)) {
+                last_winner = tree.winner();
+                last_buffer_count = source.buffer_count();
+                const auto runner_up = tree.runner_up();
+                const osmium::OSMObject& back = *source.back();
+                if (runner_up == data_sources.size() || data_sources[runner_up].empty() || order(back, *data_sources[runner_up].get())) {
+                    last_type = back.type();
+                    last_id = back.id();
+                    last_version = back.version();
+                    source.write_rest_of_buffer(writer);
+                    tree.replay();
+                    continue;
+                }
+            }
+
+            if (!duplicate) {
+                writer(object);
+                last_type = object.type();
+                last_id = object.id();
+                last_version = object.version();
+            }
+
+            source.next();
+            tree.replay();
         }
     }
 
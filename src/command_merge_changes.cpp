@@ -22,6 +22,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "command_merge_changes.hpp"
 
+#include "compacting_loader.hpp"
 #include "util.hpp"
 
 #include <osmium/io/file.hpp>
@@ -32,10 +33,10 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <osmium/memory/buffer.hpp>
 #include <osmium/object_pointer_collection.hpp>
 #include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/object.hpp>
 #include <osmium/osm/object_comparisons.hpp>
 #include <osmium/util/progress_bar.hpp>
 #include <osmium/util/verbose_output.hpp>
-#include <osmium/visitor.hpp>
 
 #include <boost/program_options.hpp>
 
@@ -99,27 +100,30 @@ bool CommandMergeChanges::run() {
     osmium::io::Writer writer{m_output_file, header, m_output_overwrite, m_fsync};
     auto out = osmium::io::make_output_iterator(writer);
 
-    // this will contain all the buffers with the input data
-    std::vector<osmium::memory::Buffer> changes;
+    // this will contain all the input data
+    CompactingLoader changes;
 
     osmium::ObjectPointerCollection objects;
 
-    // read all input files, keep the buffers around and add pointer
-    // to each object to objects collection.
+    // read all input files, copy the objects into the loader and add
+    // pointer to each object to objects collection.
     m_vout << "Reading change file contents...\n";
     osmium::ProgressBar progress_bar{file_size_sum(m_input_files), display_progress()};
     for (const osmium::io::File& change_file : m_input_files) {
         osmium::io::Reader reader{change_file, osmium::osm_entity_bits::object};
         while (osmium::memory::Buffer buffer = reader.read()) {
             progress_bar.update(reader.offset());
-            osmium::apply(buffer, objects);
-            changes.push_back(std::move(buffer));
+            changes.add(buffer, [&](osmium::OSMObject& object) {
+                objects.osm_object(object);
+            });
         }
         progress_bar.file_done(reader.file_size());
         reader.close();
     }
     progress_bar.done();
 
+    changes.report(m_vout);
+
     // Now we sort all objects and write them in order into the
     // output_buffer, flushing the output_buffer whenever it is full.
     if (m_simplify_change) {
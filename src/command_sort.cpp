@@ -22,31 +22,55 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "command_sort.hpp"
 
+#include "compacting_loader.hpp"
 #include "exception.hpp"
+#include "sort/buffer_spool.hpp"
+#include "sort/merge_sorted.hpp"
+#include "sort/object_sort.hpp"
+#include "sort/sort_estimate.hpp"
+#include "temp_file.hpp"
 #include "util.hpp"
 
+#include <osmium/io/file.hpp>
 #include <osmium/io/header.hpp>
-#include <osmium/io/output_iterator.hpp>
+#include <osmium/io/input_iterator.hpp>
 #include <osmium/io/reader.hpp>
 #include <osmium/io/writer.hpp>
 #include <osmium/memory/buffer.hpp>
-#include <osmium/object_pointer_collection.hpp>
 #include <osmium/osm/box.hpp>
 #include <osmium/osm/entity_bits.hpp>
-#include <osmium/osm/object_comparisons.hpp>
+#include <osmium/osm/item_type.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/types.hpp>
 #include <osmium/util/progress_bar.hpp>
 #include <osmium/util/verbose_output.hpp>
-#include <osmium/visitor.hpp>
 
 #include <boost/program_options.hpp>
 
 #include <algorithm>
-#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <utility>
 #include <vector>
 
 bool CommandSort::setup(const std::vector<std::string>& arguments) {
+    po::options_description opts_cmd{"COMMAND OPTIONS"};
+    opts_cmd.add_options()
+    ("dry-run", "Only estimate memory use and recommend a strategy")
+    ("max-memory", po::value<std::size_t>(), "Memory to use for 'external' strategy in MBytes (default: 1024)")
+    ("no-presorted", "Do not merge input files marked as sorted, always sort")
+    ("sort-method", po::value<std::string>(), "Sort method: 'compare' or 'radix' (default: compare)")
+    ("threads", po::value<unsigned int>(), "Number of threads used for sorting (0: all cores, default: 1)")
+    ("tmp-dir", po::value<std::string>(), "Directory for temporary files (default: $TMPDIR or /tmp)")
+    ;
+
     const po::options_description opts_common{add_common_options()};
     const po::options_description opts_input{add_multiple_inputs_options()};
     const po::options_description opts_output{add_output_options()};
@@ -58,7 +82,7 @@ bool CommandSort::setup(const std::vector<std::string>& arguments) {
     ;
 
     po::options_description desc;
-    desc.add(opts_common).add(opts_input).add(opts_output);
+    desc.add(opts_cmd).add(opts_common).add(opts_input).add(opts_output);
 
     po::options_description parsed_options;
     parsed_options.add(desc).add(hidden);
@@ -79,11 +103,59 @@ bool CommandSort::setup(const std::vector<std::string>& arguments) {
 
     if (vm.count("strategy")) {
         m_strategy = vm["strategy"].as<std::string>();
-        if (m_strategy != "simple" && m_strategy != "multipass") {
+        if (m_strategy != "simple" && m_strategy != "multipass" && m_strategy != "external" && m_strategy != "spool") {
             throw argument_error{"Unknown strategy: " + m_strategy};
         }
     }
 
+    if (vm.count("dry-run")) {
+        m_dry_run = true;
+    }
+
+    if (vm.count("max-memory")) {
+        m_max_memory_given = true;
+        m_max_memory = vm["max-memory"].as<std::size_t>();
+        if (m_max_memory == 0) {
+            throw argument_error{"Value for --max-memory must be larger than 0."};
+        }
+    }
+
+    if (vm.count("no-presorted")) {
+        m_use_presorted = false;
+    }
+
+    if (vm.count("sort-method")) {
+        const auto method = vm["sort-method"].as<std::string>();
+        if (method == "compare") {
+            m_sort_method = sort_method::compare;
+        } else if (method == "radix") {
+            m_sort_method = sort_method::radix;
+        } else {
+            throw argument_error{"Unknown sort method: " + method};
+        }
+    }
+
+    if (vm.count("threads")) {
+        m_num_threads = vm["threads"].as<unsigned int>();
+        if (m_num_threads == 0) {
+            m_num_threads = std::max(std::thread::hardware_concurrency(), 1U);
+        }
+    }
+
+    if (vm.count("tmp-dir")) {
+        m_tmp_dir = vm["tmp-dir"].as<std::string>();
+    } else {
+        m_tmp_dir = default_tmp_dir();
+    }
+
+    if (m_dry_run) {
+        if (std::any_of(m_input_filenames.cbegin(), m_input_filenames.cend(), [&](const std::string& name) {
+            return name == "-";
+        })) {
+            throw argument_error{"Can not read from STDIN when using --dry-run"};
+        }
+    }
+
     if (m_strategy == "multipass") {
         if (std::any_of(m_input_filenames.cbegin(), m_input_filenames.cend(), [&](const std::string& name) {
             return name == "-";
@@ -101,19 +173,178 @@ void CommandSort::show_arguments() {
 
     m_vout << "  other options:\n";
     m_vout << "    strategy: " << m_strategy << "\n";
+    m_vout << "    sort method: " << (m_sort_method == sort_method::radix ? "radix" : "compare") << "\n";
+    m_vout << "    threads: " << m_num_threads << "\n";
+    if (m_strategy == "external") {
+        m_vout << "    max memory: " << m_max_memory << " MBytes\n";
+    }
+    if (m_strategy == "external" || m_strategy == "spool") {
+        m_vout << "    directory for temporary files: " << m_tmp_dir << "\n";
+    }
+}
+
+void CommandSort::sort_or_merge(object_ptr_vector* objects, const std::vector<std::size_t>& bounds, bool all_sorted) {
+    if (!all_sorted) {
+        m_vout << "Sorting data...\n";
+        sort_objects(objects, m_num_threads, m_sort_method);
+        return;
+    }
+
+    if (bounds.size() > 2) {
+        m_vout << "Data from all input files is sorted already. Merging...\n";
+        merge_sorted_parts(objects, bounds, m_num_threads);
+    } else {
+        m_vout << "Data is sorted already.\n";
+    }
+}
+
+namespace {
+
+/**
+ * Reads OSM objects from a file which claims to be sorted in its header.
+ * This has the get() and next() interface needed by merge_sorted() and
+ * checks that the objects are actually in order.
+ */
+class SortedFileSource {
+
+    using it_type = osmium::io::InputIterator<osmium::io::Reader, osmium::OSMObject>;
+
+    // Type, ID, and version of an object in the order used for sorting.
+    using key_type = std::tuple<osmium::item_type, bool, osmium::unsigned_object_id_type, osmium::object_version_type>;
+
+    std::unique_ptr<osmium::io::Reader> m_reader;
+    std::string m_name;
+    it_type m_iterator;
+    key_type m_last_key;
+
+    static key_type make_key(const osmium::OSMObject& object) noexcept {
+        return key_type{object.type(), object.id() > 0, object.positive_id(), object.version()};
+    }
+
+public:
+
+    explicit SortedFileSource(const osmium::io::File& file) :
+        m_reader(std::make_unique<osmium::io::Reader>(file, osmium::osm_entity_bits::object)),
+        m_name(file.filename()),
+        m_iterator(*m_reader) {
+        if (!empty()) {
+            m_last_key = make_key(*m_iterator);
+        }
+    }
+
+    bool empty() const noexcept {
+        return m_iterator == it_type{};
+    }
+
+    const osmium::OSMObject* get() noexcept {
+        return &*m_iterator;
+    }
+
+    bool next() {
+        ++m_iterator;
+        if (empty()) {
+            return false;
+        }
+
+        const auto key = make_key(*m_iterator);
+        if (key < m_last_key) {
+            throw std::runtime_error{"Objects in input file '" + m_name +
+                                     "' out of order although its header says it is sorted."
+                                     " Use --no-presorted to sort it anyway."};
+        }
+        m_last_key = key;
+
+        return true;
+    }
+
+    std::size_t offset() const noexcept {
+        return m_reader->offset();
+    }
+
+}; // class SortedFileSource
+
+} // anonymous namespace
+
+bool CommandSort::inputs_marked_sorted() const {
+    if (std::any_of(m_input_filenames.cbegin(), m_input_filenames.cend(), [&](const std::string& name) {
+        return name == "-";
+    })) {
+        return false;
+    }
+
+    for (const auto& file : m_input_files) {
+        osmium::io::Reader reader{file, osmium::osm_entity_bits::nothing};
+        const osmium::io::Header header{reader.header()};
+        reader.close();
+        if (header.get("sorting") != "Type_then_ID") {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CommandSort::run_merge_presorted() {
+    osmium::Box bounding_box;
+
+    for (const auto& file : m_input_files) {
+        osmium::io::Reader reader{file, osmium::osm_entity_bits::nothing};
+        const osmium::io::Header header{reader.header()};
+        bounding_box.extend(header.joined_boxes());
+        reader.close();
+    }
+
+    m_vout << "Opening output file...\n";
+    osmium::io::Header header;
+    setup_header(header);
+    header.set("sorting", "Type_then_ID");
+    if (bounding_box) {
+        header.add_box(bounding_box);
+    }
+
+    osmium::io::Writer writer{m_output_file, header, m_output_overwrite, m_fsync};
+
+    m_vout << "All input files are marked as sorted. Merging them into output file...\n";
+    osmium::ProgressBar progress_bar{file_size_sum(m_input_files), display_progress()};
+    std::vector<SortedFileSource> sources;
+    sources.reserve(m_input_files.size());
+    for (const auto& file : m_input_files) {
+        sources.emplace_back(file);
+    }
+
+    std::size_t count = 0;
+    merge_sorted(sources, [&](const osmium::OSMObject& object) {
+        writer(object);
+        if (++count % 10000 == 0) {
+            progress_bar.update(std::accumulate(sources.cbegin(), sources.cend(), static_cast<std::size_t>(0), [](std::size_t sum, const SortedFileSource& source) {
+                return sum + source.offset();
+            }));
+        }
+    });
+    progress_bar.done();
+
+    m_vout << "Closing output file...\n";
+    writer.close();
+
+    show_memory_used();
+    m_vout << "Done.\n";
+
+    return true;
 }
 
 bool CommandSort::run_single_pass() {
     osmium::io::Writer writer{m_output_file, m_output_overwrite, m_fsync};
 
-    std::vector<osmium::memory::Buffer> data;
-    osmium::ObjectPointerCollection objects;
+    CompactingLoader loader;
+    object_ptr_vector objects;
 
-    osmium::Box bounding_box;
+    // Objects from each input file are in the part of the objects vector
+    // from bounds[n] to bounds[n + 1]. If all files are sorted already,
+    // those parts only have to be merged.
+    std::vector<std::size_t> bounds{0};
+    bool all_sorted = true;
 
-    uint64_t buffers_count = 0;
-    uint64_t buffers_size = 0;
-    uint64_t buffers_capacity = 0;
+    osmium::Box bounding_box;
 
     m_vout << "Reading contents of input files...\n";
     osmium::ProgressBar progress_bar{file_size_sum(m_input_files), display_progress()};
@@ -122,27 +353,21 @@ bool CommandSort::run_single_pass() {
         const osmium::io::Header header{reader.header()};
         bounding_box.extend(header.joined_boxes());
         while (osmium::memory::Buffer buffer = reader.read()) {
-            ++buffers_count;
-            buffers_size += buffer.committed();
-            buffers_capacity += buffer.capacity();
             progress_bar.update(reader.offset());
-            osmium::apply(buffer, objects);
-            data.push_back(std::move(buffer));
+            loader.add(buffer, [&](const osmium::OSMObject& object) {
+                objects.push_back(&object);
+            });
         }
         progress_bar.file_done(reader.file_size());
         reader.close();
+        if (all_sorted) {
+            all_sorted = objects_sorted(objects, bounds.back());
+        }
+        bounds.push_back(objects.size());
     }
     progress_bar.done();
 
-    m_vout << "Number of buffers: " << buffers_count << "\n";
-    m_vout << "Sum of buffer sizes: " << buffers_size << " (" << show_gbytes(buffers_size) << " GB)\n";
-
-    if (buffers_capacity != 0) {
-        const auto fill_factor = std::round(100 * static_cast<double>(buffers_size) / static_cast<double>(buffers_capacity));
-        m_vout << "Sum of buffer capacities: " << buffers_capacity << " (" << show_gbytes(buffers_capacity) << " GB, " << fill_factor << "% full)\n";
-    } else {
-        m_vout << "Sum of buffer capacities: 0 (0 GB)\n";
-    }
+    loader.report(m_vout);
 
     m_vout << "Opening output file...\n";
     osmium::io::Header header;
@@ -153,12 +378,12 @@ bool CommandSort::run_single_pass() {
     }
     writer.set_header(header);
 
-    m_vout << "Sorting data...\n";
-    objects.sort(osmium::object_order_type_id_version());
+    sort_or_merge(&objects, bounds, all_sorted);
 
     m_vout << "Writing out sorted data...\n";
-    auto out = osmium::io::make_output_iterator(writer);
-    std::copy(objects.begin(), objects.end(), out);
+    for (const auto* object : objects) {
+        writer(*object);
+    }
 
     m_vout << "Closing output file...\n";
     writer.close();
@@ -194,12 +419,10 @@ bool CommandSort::run_multi_pass() {
 
     int pass = 1;
     for (const auto entity : {osmium::osm_entity_bits::node, osmium::osm_entity_bits::way, osmium::osm_entity_bits::relation}) {
-        std::vector<osmium::memory::Buffer> data;
-        osmium::ObjectPointerCollection objects;
-
-        uint64_t buffers_count = 0;
-        uint64_t buffers_size = 0;
-        uint64_t buffers_capacity = 0;
+        CompactingLoader loader;
+        object_ptr_vector objects;
+        std::vector<std::size_t> bounds{0};
+        bool all_sorted = true;
 
         m_vout << "Pass " << pass++ << "...\n";
         m_vout << "Reading contents of input files...\n";
@@ -208,42 +431,210 @@ bool CommandSort::run_multi_pass() {
             const osmium::io::Header read_header{reader.header()};
             bounding_box.extend(read_header.joined_boxes());
             while (osmium::memory::Buffer buffer = reader.read()) {
-                ++buffers_count;
-                buffers_size += buffer.committed();
-                buffers_capacity += buffer.capacity();
                 progress_bar.update(reader.offset());
-                osmium::apply(buffer, objects);
-                data.push_back(std::move(buffer));
+                loader.add(buffer, [&](const osmium::OSMObject& object) {
+                    objects.push_back(&object);
+                });
             }
             progress_bar.file_done(reader.file_size());
             reader.close();
+            if (all_sorted) {
+                all_sorted = objects_sorted(objects, bounds.back());
+            }
+            bounds.push_back(objects.size());
         }
 
         if (m_vout.verbose()) {
             progress_bar.remove();
         }
 
-        m_vout << "Number of buffers: " << buffers_count << "\n";
-        m_vout << "Sum of buffer sizes: " << buffers_size << " (" << show_gbytes(buffers_size) << " GB)\n";
+        loader.report(m_vout);
 
-        if (buffers_capacity != 0) {
-            const auto fill_factor = std::round(100 * static_cast<double>(buffers_size) / static_cast<double>(buffers_capacity));
-            m_vout << "Sum of buffer capacities: " << buffers_capacity
-                   << " (" << show_gbytes(buffers_capacity) << " GB, " << fill_factor << "% full)\n";
-        } else {
-            m_vout << "Sum of buffer capacities: 0 (0 GB)\n";
+        sort_or_merge(&objects, bounds, all_sorted);
+
+        m_vout << "Writing out sorted data...\n";
+        for (const auto* object : objects) {
+            writer(*object);
         }
+    }
 
-        m_vout << "Sorting data...\n";
-        objects.sort(osmium::object_order_type_id_version());
+    progress_bar.done();
 
-        m_vout << "Writing out sorted data...\n";
-        auto out = osmium::io::make_output_iterator(writer);
-        std::copy(objects.begin(), objects.end(), out);
+    m_vout << "Closing output file...\n";
+    writer.close();
+
+    show_memory_used();
+    m_vout << "Done.\n";
+
+    return true;
+}
+
+bool CommandSort::run_spool() {
+    osmium::io::Writer writer{m_output_file, m_output_overwrite, m_fsync};
+
+    osmium::Box bounding_box;
+
+    // One spool for each of nodes, ways, and relations.
+    std::vector<BufferSpool> spools;
+    for (int i = 0; i < 3; ++i) {
+        spools.emplace_back(m_tmp_dir);
+    }
+
+    m_vout << "Reading contents of input files and writing them to temporary files by type...\n";
+    osmium::ProgressBar progress_bar{file_size_sum(m_input_files), display_progress()};
+    for (const auto& file : m_input_files) {
+        osmium::io::Reader reader{file, osmium::osm_entity_bits::nwr};
+        const osmium::io::Header header{reader.header()};
+        bounding_box.extend(header.joined_boxes());
+        while (osmium::memory::Buffer buffer = reader.read()) {
+            progress_bar.update(reader.offset());
+            for (const auto& object : buffer.select<osmium::OSMObject>()) {
+                spools[osmium::item_type_to_nwr_index(object.type())].add(object);
+            }
+        }
+        progress_bar.file_done(reader.file_size());
+        reader.close();
+    }
+    progress_bar.done();
+
+    m_vout << "Opening output file...\n";
+    osmium::io::Header header;
+    setup_header(header);
+    header.set("sorting", "Type_then_ID");
+    if (bounding_box) {
+        header.add_box(bounding_box);
+    }
+    writer.set_header(header);
+
+    const char* const type_names[] = {"nodes", "ways", "relations"};
+    for (std::size_t i = 0; i < spools.size(); ++i) {
+        auto& spool = spools[i];
+        spool.rewind();
+
+        m_vout << "Reading " << type_names[i] << " (" << show_mbytes(spool.bytes()) << " MBytes) from temporary file...\n";
+        std::vector<osmium::memory::Buffer> data;
+        object_ptr_vector objects;
+        while (osmium::memory::Buffer buffer = spool.read()) {
+            add_objects(buffer, &objects);
+            data.push_back(std::move(buffer));
+        }
+
+        m_vout << "Sorting " << type_names[i] << "...\n";
+        sort_objects(&objects, m_num_threads, m_sort_method);
+
+        m_vout << "Writing out sorted " << type_names[i] << "...\n";
+        for (const auto* object : objects) {
+            writer(*object);
+        }
     }
 
+    m_vout << "Closing output file...\n";
+    writer.close();
+
+    show_memory_used();
+    m_vout << "Done.\n";
+
+    return true;
+}
+
+namespace {
+
+// Maximum number of sorted runs merged in one go. If there are more runs,
+// they are merged in several rounds. This keeps the number of open files
+// and the memory needed for the read buffers of all runs small.
+constexpr const std::size_t max_merge_fan_in = 64;
+
+} // anonymous namespace
+
+bool CommandSort::run_external() {
+    osmium::io::Writer writer{m_output_file, m_output_overwrite, m_fsync};
+
+    const std::size_t max_memory = m_max_memory * 1024UL * 1024UL;
+
+    // Use smaller arenas for small memory settings so not too much memory
+    // is wasted in the last arena of each run.
+    CompactingLoader loader{std::min(CompactingLoader::default_arena_size, max_memory / 16)};
+    object_ptr_vector objects;
+
+    std::vector<BufferSpool> runs;
+
+    const auto write_run = [&]() {
+        sort_objects(&objects, m_num_threads, m_sort_method);
+        runs.emplace_back(m_tmp_dir);
+        for (const auto* object : objects) {
+            runs.back().add(*object);
+        }
+        runs.back().flush();
+        objects.clear();
+        loader.clear();
+    };
+
+    osmium::Box bounding_box;
+
+    m_vout << "Reading contents of input files...\n";
+    osmium::ProgressBar progress_bar{file_size_sum(m_input_files), display_progress()};
+    for (const auto& file : m_input_files) {
+        osmium::io::Reader reader{file, osmium::osm_entity_bits::object};
+        const osmium::io::Header header{reader.header()};
+        bounding_box.extend(header.joined_boxes());
+        while (osmium::memory::Buffer buffer = reader.read()) {
+            progress_bar.update(reader.offset());
+            loader.add(buffer, [&](const osmium::OSMObject& object) {
+                objects.push_back(&object);
+            });
+
+            const auto data_size = loader.capacity();
+            if (data_size + objects.size() * sort_memory_per_object(m_sort_method) >= max_memory) {
+                if (m_vout.verbose()) {
+                    progress_bar.remove();
+                }
+                m_vout << "Sorting data and writing run " << (runs.size() + 1)
+                       << " to temporary file (" << show_mbytes(data_size) << " MBytes in memory)...\n";
+                write_run();
+            }
+        }
+        progress_bar.file_done(reader.file_size());
+        reader.close();
+    }
     progress_bar.done();
 
+    m_vout << "Opening output file...\n";
+    osmium::io::Header header;
+    setup_header(header);
+    header.set("sorting", "Type_then_ID");
+    if (bounding_box) {
+        header.add_box(bounding_box);
+    }
+    writer.set_header(header);
+
+    if (runs.empty()) {
+        m_vout << "All data fits into memory.\n";
+        m_vout << "Sorting data...\n";
+        sort_objects(&objects, m_num_threads, m_sort_method);
+
+        m_vout << "Writing out sorted data...\n";
+        for (const auto* object : objects) {
+            writer(*object);
+        }
+    } else {
+        if (!objects.empty()) {
+            m_vout << "Sorting data and writing run " << (runs.size() + 1) << " to temporary file...\n";
+            write_run();
+        }
+
+        merge_runs(&runs, max_merge_fan_in, m_tmp_dir, m_vout);
+
+        m_vout << "Merging " << runs.size() << " runs and writing out sorted data...\n";
+        std::vector<SpoolSource> sources;
+        for (auto& run : runs) {
+            run.rewind();
+            sources.emplace_back(run);
+        }
+        merge_sorted(sources, [&](const osmium::OSMObject& object) {
+            writer(object);
+        });
+    }
+
     m_vout << "Closing output file...\n";
     writer.close();
 
@@ -253,10 +644,98 @@ bool CommandSort::run_multi_pass() {
     return true;
 }
 
+namespace {
+
+// Maximum number of PBF blobs decoded for the --dry-run estimate.
+constexpr const std::size_t max_estimate_samples = 100;
+
+// Memory needed by the external strategy in addition to the configured
+// maximum when merging runs: one chunk read from each temporary file.
+constexpr const std::size_t external_merge_memory = max_merge_fan_in * 1024UL * 1024UL;
+
+} // anonymous namespace
+
+bool CommandSort::run_dry_run() {
+    m_vout << "Estimating size of input data...\n";
+    const auto estimate = estimate_sort_input(m_input_files, max_estimate_samples);
+    const std::size_t per_object = sort_memory_per_object(m_sort_method);
+
+    const std::uint64_t total = estimate.total_data_bytes() + estimate.total_objects() * per_object;
+
+    // Memory needed for the largest type. If there is input with unknown
+    // types, we have to assume all of it is of the same type.
+    std::uint64_t largest_type = 0;
+    for (std::size_t i = 0; i < 3; ++i) {
+        largest_type = std::max(largest_type, estimate.data_bytes[i] + estimate.objects[i] * per_object);
+    }
+    if (estimate.unknown_type_bytes > 0) {
+        largest_type = total;
+    }
+
+    const std::uint64_t external = std::min<std::uint64_t>(total, m_max_memory * 1024UL * 1024UL + external_merge_memory);
+
+    std::size_t available = m_max_memory * 1024UL * 1024UL;
+    const char* available_source = "--max-memory";
+    if (!m_max_memory_given) {
+        const auto physical = physical_memory();
+        if (physical > 0) {
+            available = physical;
+            available_source = "physical memory";
+        } else {
+            available_source = "default for --max-memory";
+        }
+    }
+
+    const char* recommended = "external";
+    if (total <= available) {
+        recommended = "simple";
+    } else if (largest_type <= available) {
+        recommended = "spool";
+    }
+
+    std::cout << "Input files: " << m_input_files.size() << " (" << show_mbytes(file_size_sum(m_input_files)) << " MBytes)\n";
+    if (estimate.blobs > 0) {
+        std::cout << "PBF data blobs: " << estimate.blobs << " (" << estimate.sampled_blobs << " sampled)\n";
+        std::cout << "Estimated number of objects:\n";
+        std::cout << "  nodes: " << estimate.objects[0] << "\n";
+        std::cout << "  ways: " << estimate.objects[1] << "\n";
+        std::cout << "  relations: " << estimate.objects[2] << "\n";
+    }
+    if (estimate.unknown_type_bytes > 0) {
+        std::cout << "Non-PBF input: estimated from file size only\n";
+    }
+    std::cout << "Estimated memory for data: " << show_mbytes(estimate.total_data_bytes()) << " MBytes\n";
+    std::cout << "Estimated peak memory by strategy (sort method "
+              << (m_sort_method == sort_method::radix ? "radix" : "compare") << "):\n";
+    std::cout << "  simple: " << show_mbytes(total) << " MBytes\n";
+    std::cout << "  multipass: " << show_mbytes(largest_type) << " MBytes\n";
+    std::cout << "  spool: " << show_mbytes(largest_type) << " MBytes\n";
+    std::cout << "  external: " << show_mbytes(external) << " MBytes\n";
+    std::cout << "Memory available: " << show_mbytes(available) << " MBytes (" << available_source << ")\n";
+    std::cout << "Recommended strategy: " << recommended << "\n";
+    if (m_use_presorted && inputs_marked_sorted()) {
+        std::cout << "All input files are marked as sorted, they will be merged using very little memory.\n";
+    }
+
+    return true;
+}
+
 bool CommandSort::run() {
+    if (m_dry_run) {
+        return run_dry_run();
+    }
+    if (m_use_presorted && inputs_marked_sorted()) {
+        return run_merge_presorted();
+    }
     if (m_strategy == "simple") {
         return run_single_pass();
     }
+    if (m_strategy == "external") {
+        return run_external();
+    }
+    if (m_strategy == "spool") {
+        return run_spool();
+    }
     return run_multi_pass();
 }
 
@@ -24,13 +24,26 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include "cmd.hpp" // IWYU pragma: export
+#include "sort/object_sort.hpp"
 
+#include <cstddef>
 #include <string>
 #include <vector>
 
 class CommandSort : public CommandWithMultipleOSMInputs, public with_osm_output {
 
     std::string m_strategy{"simple"};
+    std::string m_tmp_dir;
+    std::size_t m_max_memory = 1024; // MBytes
+    bool m_max_memory_given = false;
+    bool m_dry_run = false;
+    unsigned int m_num_threads = 1;
+    sort_method m_sort_method = sort_method::compare;
+    bool m_use_presorted = true;
+
+    void sort_or_merge(object_ptr_vector* objects, const std::vector<std::size_t>& bounds, bool all_sorted);
+
+    bool inputs_marked_sorted() const;
 
 public:
 
@@ -46,6 +59,14 @@ public:
 
     bool run_multi_pass();
 
+    bool run_external();
+
+    bool run_spool();
+
+    bool run_merge_presorted();
+
+    bool run_dry_run();
+
     bool run() override final;
 
     const char* name() const noexcept override final {
@@ -0,0 +1,79 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "compacting_loader.hpp"
+
+#include "util.hpp"
+
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/util/verbose_output.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+osmium::OSMObject& CompactingLoader::copy(const osmium::OSMObject& object) {
+    if (m_arenas.empty() || m_arenas.back().capacity() - m_arenas.back().committed() < object.padded_size()) {
+        m_arenas.emplace_back(std::max(m_arena_size, object.padded_size()), osmium::memory::Buffer::auto_grow::no);
+    }
+
+    auto& arena = m_arenas.back();
+    auto& new_object = arena.add_item(object);
+    arena.commit();
+
+    return new_object;
+}
+
+std::size_t CompactingLoader::capacity() const noexcept {
+    std::size_t sum = 0;
+    for (const auto& arena : m_arenas) {
+        sum += arena.capacity();
+    }
+    return sum;
+}
+
+void CompactingLoader::clear() {
+    m_arenas.clear();
+    m_input_buffers = 0;
+    m_input_committed = 0;
+    m_input_capacity = 0;
+}
+
+void CompactingLoader::report(osmium::VerboseOutput& vout) const {
+    vout << "Number of buffers: " << m_input_buffers << "\n";
+    vout << "Sum of buffer sizes: " << m_input_committed << " (" << show_gbytes(m_input_committed) << " GB)\n";
+
+    if (m_input_capacity == 0) {
+        vout << "Sum of buffer capacities: 0 (0 GB)\n";
+        return;
+    }
+
+    const auto fill_factor = std::round(100 * static_cast<double>(m_input_committed) / static_cast<double>(m_input_capacity));
+    vout << "Sum of buffer capacities: " << m_input_capacity
+         << " (" << show_gbytes(m_input_capacity) << " GB, " << fill_factor << "% full)\n";
+
+    const auto arena_capacity = capacity();
+    const auto ratio = std::round(100 * static_cast<double>(arena_capacity) / static_cast<double>(m_input_capacity));
+    vout << "Data compacted into " << m_arenas.size() << " buffers with capacity " << arena_capacity
+         << " (" << show_gbytes(arena_capacity) << " GB, " << ratio << "% of original capacity)\n";
+}
@@ -0,0 +1,96 @@
+#ifndef COMPACTING_LOADER_HPP
+#define COMPACTING_LOADER_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/memory/buffer.hpp>
+#include <osmium/memory/item.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/util/verbose_output.hpp>
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Keeps OSM objects in memory, for instance for sorting them. The objects
+ * from the buffers returned by a reader are copied into large, densely
+ * packed arena buffers, so the reader buffers (which are often only
+ * partly filled) can be released. This way the memory used is close to
+ * the size of the actual data.
+ *
+ * The arena buffers never grow, so pointers to the objects stay valid
+ * until the loader is cleared or destroyed.
+ */
+class CompactingLoader {
+
+    std::vector<osmium::memory::Buffer> m_arenas;
+    std::size_t m_arena_size;
+
+    std::size_t m_input_buffers = 0;
+    std::size_t m_input_committed = 0;
+    std::size_t m_input_capacity = 0;
+
+    osmium::OSMObject& copy(const osmium::OSMObject& object);
+
+public:
+
+    static constexpr const std::size_t default_arena_size = 16UL * 1024UL * 1024UL;
+
+    explicit CompactingLoader(std::size_t arena_size = default_arena_size) :
+        m_arena_size(osmium::memory::padded_length(arena_size)) {
+    }
+
+    /**
+     * Copy all OSM objects in the buffer into the arena and call func()
+     * with a (non-const) reference to each copied object.
+     */
+    template <typename TFunc>
+    void add(const osmium::memory::Buffer& buffer, TFunc&& func) {
+        ++m_input_buffers;
+        m_input_committed += buffer.committed();
+        m_input_capacity += buffer.capacity();
+        for (const auto& object : buffer.select<osmium::OSMObject>()) {
+            func(copy(object));
+        }
+    }
+
+    /// The arena buffers containing all objects in the order they were added.
+    const std::vector<osmium::memory::Buffer>& buffers() const noexcept {
+        return m_arenas;
+    }
+
+    /// Memory used by the arena buffers.
+    std::size_t capacity() const noexcept;
+
+    /// Release all arena buffers and reset the statistics.
+    void clear();
+
+    /**
+     * Write statistics about the input buffers and the arena buffers
+     * to the verbose output.
+     */
+    void report(osmium::VerboseOutput& vout) const;
+
+}; // class CompactingLoader
+
+#endif // COMPACTING_LOADER_HPP
@@ -0,0 +1,64 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "buffer_budget.hpp"
+
+#include <osmium/util/config.hpp>
+
+#include <cassert>
+#include <cstddef>
+
+BufferBudget::BufferBudget(std::size_t limit, std::size_t queue_size) noexcept :
+    m_limit(limit),
+    m_queue_size(queue_size) {
+}
+
+std::size_t BufferBudget::writer_queue_size() noexcept {
+    // Same setting and default as used by the osmium::io::Writer.
+    return osmium::config::get_max_queue_size("OUTPUT", 20);
+}
+
+void BufferBudget::update_peak(std::size_t used) noexcept {
+    std::size_t peak = m_peak;
+    while (used > peak && !m_peak.compare_exchange_weak(peak, used)) {
+    }
+}
+
+bool BufferBudget::try_take(std::size_t bytes) noexcept {
+    std::size_t used = m_used;
+    do {
+        if (used + bytes > m_limit) {
+            return false;
+        }
+    } while (!m_used.compare_exchange_weak(used, used + bytes));
+    update_peak(used + bytes);
+    return true;
+}
+
+void BufferBudget::take(std::size_t bytes) noexcept {
+    update_peak(m_used += bytes);
+}
+
+void BufferBudget::give_back(std::size_t bytes) noexcept {
+    assert(m_used >= bytes);
+    m_used -= bytes;
+}
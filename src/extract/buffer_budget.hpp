@@ -0,0 +1,95 @@
+#ifndef EXTRACT_BUFFER_BUDGET_HPP
+#define EXTRACT_BUFFER_BUDGET_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Memory budget shared by the output buffers of all extracts. It counts
+ * the memory for the buffer an extract fills and the memory for the
+ * buffers already handed to the writer of the extract, but not written
+ * out yet. The writer keeps at most queue_size() of those in its queue,
+ * so an extract with buffers of size S needs at most
+ * (queue_size() + 1) * S bytes.
+ *
+ * This can be used from several threads at the same time.
+ */
+class BufferBudget {
+
+    std::size_t m_limit;
+    std::size_t m_queue_size;
+    std::atomic<std::size_t> m_used{0};
+    std::atomic<std::size_t> m_peak{0};
+
+    void update_peak(std::size_t used) noexcept;
+
+public:
+
+    /**
+     * Create budget of limit bytes for writers with output queues of
+     * queue_size entries.
+     */
+    BufferBudget(std::size_t limit, std::size_t queue_size) noexcept;
+
+    /// The queue size of libosmium writers set in the environment.
+    static std::size_t writer_queue_size() noexcept;
+
+    std::size_t limit() const noexcept {
+        return m_limit;
+    }
+
+    std::size_t queue_size() const noexcept {
+        return m_queue_size;
+    }
+
+    /// Memory needed by an extract with buffers of the given size.
+    std::size_t memory_for(std::size_t buffer_size) const noexcept {
+        return (m_queue_size + 1) * buffer_size;
+    }
+
+    std::size_t used() const noexcept {
+        return m_used;
+    }
+
+    /// The largest amount of memory that was in use at any time.
+    std::size_t peak() const noexcept {
+        return m_peak;
+    }
+
+    /**
+     * Take bytes from the budget if that doesn't exceed the limit.
+     * Returns false otherwise.
+     */
+    bool try_take(std::size_t bytes) noexcept;
+
+    /// Take bytes from the budget even if that exceeds the limit.
+    void take(std::size_t bytes) noexcept;
+
+    /// Give bytes back to the budget.
+    void give_back(std::size_t bytes) noexcept;
+
+}; // class BufferBudget
+
+#endif // EXTRACT_BUFFER_BUDGET_HPP
@@ -0,0 +1,172 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "crossing_kernel.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+# define OSMIUM_WITH_AVX2_KERNEL
+# include <cmath>
+# include <immintrin.h>
+#endif
+
+namespace {
+
+// Does the segment n flip the inside/outside state? Only call this for
+// segments crossing the horizontal line through the location.
+bool flips(const band_segments& s, std::size_t n, int32_t x, int32_t y) noexcept {
+    const auto ax = static_cast<int64_t>(s.x1[n]) - static_cast<int64_t>(s.x2[n]);
+    const auto ay = static_cast<int64_t>(s.y1[n]) - static_cast<int64_t>(s.y2[n]);
+    const auto tx = static_cast<int64_t>(x)       - static_cast<int64_t>(s.x2[n]);
+    const auto ty = static_cast<int64_t>(y)       - static_cast<int64_t>(s.y2[n]);
+
+    const bool comp = tx * ay < ax * ty;
+
+    return (ay > 0) == comp;
+}
+
+// Scalar test of segments begin to end, returns 2 if the location is the
+// end point of a segment, otherwise the parity of the crossings.
+unsigned int check_segments(const band_segments& s, std::size_t begin, std::size_t end, int32_t x, int32_t y) noexcept {
+    unsigned int inside = 0;
+
+    for (std::size_t n = begin; n < end; ++n) {
+        if ((s.x1[n] == x && s.y1[n] == y) || (s.x2[n] == x && s.y2[n] == y)) {
+            return 2;
+        }
+        if ((s.y2[n] > y) != (s.y1[n] > y) && flips(s, n, x, y)) {
+            inside ^= 1U;
+        }
+    }
+
+    return inside;
+}
+
+#ifdef OSMIUM_WITH_AVX2_KERNEL
+
+// Checks four segments at a time using doubles. Coordinates and their
+// differences (up to 33 bits) are exact in a double, but the products
+// (up to 63 bits) are not. If the difference between the products is
+// too small to be sure of its sign, the segment is checked again with
+// the exact integer arithmetic.
+__attribute__((target("avx2")))
+bool location_in_band_avx2(const band_segments& s, int32_t x, int32_t y) noexcept {
+    const __m256d lx = _mm256_set1_pd(static_cast<double>(x));
+    const __m256d ly = _mm256_set1_pd(static_cast<double>(y));
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+    const __m256d max_error = _mm256_set1_pd(std::ldexp(1.0, -50));
+
+    unsigned int crossings = 0;
+    std::size_t n = 0;
+    for (; n + 4 <= s.size; n += 4) {
+        const __m256d x1 = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s.x1 + n)));
+        const __m256d y1 = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s.y1 + n)));
+        const __m256d x2 = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s.x2 + n)));
+        const __m256d y2 = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s.y2 + n)));
+
+        const __m256d vertex1 = _mm256_and_pd(_mm256_cmp_pd(x1, lx, _CMP_EQ_OQ), _mm256_cmp_pd(y1, ly, _CMP_EQ_OQ));
+        const __m256d vertex2 = _mm256_and_pd(_mm256_cmp_pd(x2, lx, _CMP_EQ_OQ), _mm256_cmp_pd(y2, ly, _CMP_EQ_OQ));
+        if (_mm256_movemask_pd(_mm256_or_pd(vertex1, vertex2))) {
+            return true;
+        }
+
+        const int crossing = _mm256_movemask_pd(_mm256_xor_pd(_mm256_cmp_pd(y2, ly, _CMP_GT_OQ), _mm256_cmp_pd(y1, ly, _CMP_GT_OQ)));
+        if (!crossing) {
+            continue;
+        }
+
+        const __m256d ax = _mm256_sub_pd(x1, x2);
+        const __m256d ay = _mm256_sub_pd(y1, y2);
+        const __m256d tx = _mm256_sub_pd(lx, x2);
+        const __m256d ty = _mm256_sub_pd(ly, y2);
+
+        const __m256d p1 = _mm256_mul_pd(tx, ay);
+        const __m256d p2 = _mm256_mul_pd(ax, ty);
+        const __m256d diff = _mm256_sub_pd(p1, p2);
+        const __m256d bound = _mm256_mul_pd(_mm256_add_pd(_mm256_and_pd(p1, abs_mask), _mm256_and_pd(p2, abs_mask)), max_error);
+
+        const int uncertain = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_and_pd(diff, abs_mask), bound, _CMP_LE_OQ)) & crossing;
+        const int comp = _mm256_movemask_pd(_mm256_cmp_pd(diff, zero, _CMP_LT_OQ));
+        const int ay_positive = _mm256_movemask_pd(_mm256_cmp_pd(ay, zero, _CMP_GT_OQ));
+
+        const int flipped = ~(ay_positive ^ comp) & crossing & ~uncertain & 0xf;
+        crossings += static_cast<unsigned int>(__builtin_popcount(static_cast<unsigned int>(flipped)));
+
+        for (int lane = 0; lane < 4; ++lane) {
+            if ((uncertain & (1 << lane)) && flips(s, n + static_cast<std::size_t>(lane), x, y)) {
+                ++crossings;
+            }
+        }
+    }
+
+    const auto rest = check_segments(s, n, s.size, x, y);
+    if (rest == 2) {
+        return true;
+    }
+
+    return ((crossings + rest) & 1U) != 0;
+}
+
+bool cpu_has_avx2() noexcept {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+using kernel_type = bool (*)(const band_segments&, int32_t, int32_t) noexcept;
+
+struct kernel_info {
+    kernel_type func;
+    const char* name;
+};
+
+kernel_info select_kernel() noexcept {
+#ifdef OSMIUM_WITH_AVX2_KERNEL
+    if (cpu_has_avx2()) {
+        return {location_in_band_avx2, "avx2"};
+    }
+#endif
+    return {location_in_band_scalar, "scalar"};
+}
+
+const kernel_info& kernel() noexcept {
+    static const kernel_info info = select_kernel();
+    return info;
+}
+
+} // anonymous namespace
+
+bool location_in_band_scalar(const band_segments& segments, int32_t x, int32_t y) noexcept {
+    return check_segments(segments, 0, segments.size, x, y) != 0;
+}
+
+bool location_in_band(const band_segments& segments, int32_t x, int32_t y) noexcept {
+    return kernel().func(segments, x, y);
+}
+
+const char* crossing_kernel_name() noexcept {
+    return kernel().name;
+}
@@ -0,0 +1,59 @@
+#ifndef EXTRACT_CROSSING_KERNEL_HPP
+#define EXTRACT_CROSSING_KERNEL_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Segments of one band of a polygon in structure-of-arrays layout. The
+ * segment n goes from (x1[n], y1[n]) to (x2[n], y2[n]).
+ */
+struct band_segments {
+    const int32_t* x1;
+    const int32_t* y1;
+    const int32_t* x2;
+    const int32_t* y2;
+    std::size_t size;
+};
+
+/**
+ * Crossing number test for a location against the segments of a band.
+ * Returns true if the location is inside the polygon, which is the case
+ * if an odd number of segments cross the horizontal line through the
+ * location to the left of it, or if the location is the end point of a
+ * segment.
+ *
+ * This uses a vectorized implementation if the CPU supports it. The
+ * result is always exactly the same as the one from the scalar version.
+ */
+bool location_in_band(const band_segments& segments, int32_t x, int32_t y) noexcept;
+
+/// Scalar version of location_in_band().
+bool location_in_band_scalar(const band_segments& segments, int32_t x, int32_t y) noexcept;
+
+/// Name of the implementation used by location_in_band().
+const char* crossing_kernel_name() noexcept;
+
+#endif // EXTRACT_CROSSING_KERNEL_HPP
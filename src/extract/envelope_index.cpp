@@ -0,0 +1,113 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "envelope_index.hpp"
+
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+std::size_t EnvelopeIndex::column(int32_t x) noexcept {
+    const auto c = static_cast<int64_t>(x) + 180 * static_cast<int64_t>(cell_size);
+    return std::min(static_cast<std::size_t>(std::max(c, static_cast<int64_t>(0)) / cell_size), columns - 1);
+}
+
+std::size_t EnvelopeIndex::row(int32_t y) noexcept {
+    const auto r = static_cast<int64_t>(y) + 90 * static_cast<int64_t>(cell_size);
+    return std::min(static_cast<std::size_t>(std::max(r, static_cast<int64_t>(0)) / cell_size), rows - 1);
+}
+
+namespace {
+
+std::vector<std::vector<osmium::Box>> one_envelope_each(const std::vector<osmium::Box>& envelopes) {
+    std::vector<std::vector<osmium::Box>> result;
+    result.reserve(envelopes.size());
+    for (const auto& envelope : envelopes) {
+        result.push_back({envelope});
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+EnvelopeIndex::EnvelopeIndex(const std::vector<osmium::Box>& envelopes) :
+    EnvelopeIndex(one_envelope_each(envelopes)) {
+}
+
+EnvelopeIndex::EnvelopeIndex(const std::vector<std::vector<osmium::Box>>& envelopes) :
+    m_offsets(columns * rows + 1, 0) {
+
+    // Get the cells overlapping any of the envelopes of an extract, each
+    // cell only once. Extracts without a valid envelope end up in all
+    // cells, so they still see all nodes.
+    std::vector<std::size_t> cells;
+    const auto get_cells = [&cells](const std::vector<osmium::Box>& extract_envelopes) -> const std::vector<std::size_t>& {
+        cells.clear();
+        for (const auto& envelope : extract_envelopes) {
+            std::size_t col_min = 0;
+            std::size_t col_max = columns - 1;
+            std::size_t row_min = 0;
+            std::size_t row_max = rows - 1;
+            if (envelope.valid()) {
+                col_min = column(envelope.bottom_left().x());
+                col_max = column(envelope.top_right().x());
+                row_min = row(envelope.bottom_left().y());
+                row_max = row(envelope.top_right().y());
+            }
+            for (std::size_t r = row_min; r <= row_max; ++r) {
+                for (std::size_t c = col_min; c <= col_max; ++c) {
+                    cells.push_back(r * columns + c);
+                }
+            }
+        }
+        if (extract_envelopes.size() > 1) {
+            std::sort(cells.begin(), cells.end());
+            cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+        }
+        return cells;
+    };
+
+    // First count the extracts in each cell, then fill in the extract
+    // indexes. Because the extracts are added in order, the indexes in
+    // each cell are sorted.
+    for (const auto& extract_envelopes : envelopes) {
+        for (const auto cell : get_cells(extract_envelopes)) {
+            ++m_offsets[cell + 1];
+        }
+    }
+
+    for (std::size_t n = 1; n < m_offsets.size(); ++n) {
+        m_offsets[n] += m_offsets[n - 1];
+    }
+
+    m_extracts.resize(m_offsets.back());
+    std::vector<uint32_t> fill{m_offsets.begin(), m_offsets.end() - 1};
+    for (std::size_t i = 0; i < envelopes.size(); ++i) {
+        for (const auto cell : get_cells(envelopes[i])) {
+            m_extracts[fill[cell]++] = static_cast<uint32_t>(i);
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef EXTRACT_ENVELOPE_INDEX_HPP
+#define EXTRACT_ENVELOPE_INDEX_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Index over the envelopes of all extracts. The world is divided into a
+ * grid of 1 by 1 degree cells. Each cell has a list of all extracts with
+ * an envelope overlapping the cell. This way the extracts which might contain
+ * a location can be found without looking at all extracts.
+ */
+class EnvelopeIndex {
+
+    static constexpr const int32_t cell_size = osmium::detail::coordinate_precision; // 1 degree
+    static constexpr const std::size_t columns = 360;
+    static constexpr const std::size_t rows = 180;
+
+    // The extracts in cell n are in m_extracts[m_offsets[n]] up to (but
+    // not including) m_extracts[m_offsets[n + 1]].
+    std::vector<uint32_t> m_offsets;
+    std::vector<uint32_t> m_extracts;
+
+    static std::size_t column(int32_t x) noexcept;
+
+    static std::size_t row(int32_t y) noexcept;
+
+public:
+
+    /**
+     * Create index from the envelopes of the extracts. The position of
+     * each envelope in the vector is the extract index reported by
+     * for_each().
+     */
+    explicit EnvelopeIndex(const std::vector<osmium::Box>& envelopes);
+
+    /**
+     * Create index from the envelopes of the extracts, each extract can
+     * have several envelopes. The position of the envelopes of each
+     * extract in the outer vector is the extract index reported by
+     * for_each().
+     */
+    explicit EnvelopeIndex(const std::vector<std::vector<osmium::Box>>& envelopes);
+
+    /**
+     * Call func with the index of each extract whose envelope might
+     * contain the location. The indexes are in ascending order. Nothing
+     * is called for invalid locations, because they are never in any
+     * extract.
+     */
+    template <typename TFunc>
+    void for_each(const osmium::Location& location, TFunc&& func) const {
+        if (!location.valid()) {
+            return;
+        }
+        const std::size_t cell = row(location.y()) * columns + column(location.x());
+        for (auto n = m_offsets[cell]; n < m_offsets[cell + 1]; ++n) {
+            func(static_cast<std::size_t>(m_extracts[n]));
+        }
+    }
+
+    /// The number of entries in all cells together.
+    std::size_t size() const noexcept {
+        return m_extracts.size();
+    }
+
+}; // class EnvelopeIndex
+
+#endif // EXTRACT_ENVELOPE_INDEX_HPP
@@ -23,32 +23,117 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "extract.hpp"
 
 #include <osmium/io/writer_options.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/way.hpp>
 
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
 #include <memory>
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
-void Extract::open_file(const osmium::io::Header& header, osmium::io::overwrite output_overwrite, osmium::io::fsync sync, OptionClean const* clean) {
+void Extract::set_buffer_size(std::size_t size) noexcept {
+    m_buffer_size = std::max(size, min_buffer_size);
+}
+
+void Extract::open_file(const osmium::io::Header& header, osmium::io::overwrite output_overwrite, osmium::io::fsync sync, OptionClean const* clean, osmium::thread::Pool* pool) {
     m_clean = clean;
-    m_writer = std::make_unique<osmium::io::Writer>(m_output_file, header, output_overwrite, sync);
+    if (pool) {
+        m_writer = std::make_unique<osmium::io::Writer>(m_output_file, header, output_overwrite, sync, *pool);
+    } else {
+        m_writer = std::make_unique<osmium::io::Writer>(m_output_file, header, output_overwrite, sync);
+    }
+}
+
+void Extract::contains_batch(const std::vector<osmium::Location>& locations, std::vector<bool>* results) const {
+    results->resize(locations.size());
+    for (std::size_t n = 0; n < locations.size(); ++n) {
+        (*results)[n] = contains(locations[n]);
+    }
 }
 
 void Extract::close_file() {
     if (m_writer) {
-        if (m_buffer.committed() > 0) {
-            m_clean->apply_to(m_buffer);
-            (*m_writer)(std::move(m_buffer));
+        if (m_buffer && m_buffer.committed() > 0) {
+            flush_buffer();
         }
+        m_buffer = osmium::memory::Buffer{};
         m_writer->close();
     }
+    if (m_budget && m_current_buffer_size > 0) {
+        m_budget->give_back(m_budget->memory_for(m_current_buffer_size));
+        m_current_buffer_size = 0;
+    }
+}
+
+void Extract::add_to_state(const osmium::memory::Item& item) {
+    assert(m_state);
+    switch (item.type()) {
+        case osmium::item_type::node:
+            m_state->nodes().set(static_cast<const osmium::Node&>(item).positive_id());
+            break;
+        case osmium::item_type::way:
+            m_state->ways().set(static_cast<const osmium::Way&>(item).positive_id());
+            break;
+        case osmium::item_type::relation:
+            m_state->relations().set(static_cast<const osmium::Relation&>(item).positive_id());
+            break;
+        default:
+            break;
+    }
+}
+
+void Extract::add_inside_node(const osmium::Node& node) {
+    if (m_state && node.visible()) {
+        m_state->inside_nodes().set(node.positive_id());
+    }
+}
+
+std::size_t Extract::next_buffer_size() {
+    if (!m_budget) {
+        return m_buffer_size;
+    }
+
+    // The first buffer has the smallest size. It is always allowed, even
+    // if that exceeds the budget, otherwise the extract could not be
+    // written at all.
+    if (m_current_buffer_size == 0) {
+        m_current_buffer_size = min_buffer_size;
+        m_budget->take(m_budget->memory_for(m_current_buffer_size));
+        return m_current_buffer_size;
+    }
+
+    // This is only called again after a buffer was full, so the extract
+    // gets a lot of data and larger buffers are worth it.
+    if (m_current_buffer_size < m_buffer_size) {
+        const auto size = std::min(m_current_buffer_size * 2, m_buffer_size);
+        if (m_budget->try_take(m_budget->memory_for(size - m_current_buffer_size))) {
+            m_current_buffer_size = size;
+        }
+    }
+
+    return m_current_buffer_size;
+}
+
+void Extract::flush_buffer() {
+    m_clean->apply_to(m_buffer);
+    (*m_writer)(std::move(m_buffer));
+    m_buffer = osmium::memory::Buffer{};
 }
 
 void Extract::write(const osmium::memory::Item& item) {
-    if (m_buffer.capacity() - m_buffer.committed() < item.padded_size()) {
-        m_clean->apply_to(m_buffer);
-        (*m_writer)(std::move(m_buffer));
-        m_buffer = osmium::memory::Buffer{buffer_size, osmium::memory::Buffer::auto_grow::no};
+    if (m_state) {
+        add_to_state(item);
+    }
+    if (m_buffer && m_buffer.capacity() - m_buffer.committed() < item.padded_size()) {
+        flush_buffer();
+    }
+    if (!m_buffer) {
+        m_buffer = osmium::memory::Buffer{std::max(next_buffer_size(), item.padded_size()), osmium::memory::Buffer::auto_grow::no};
     }
     m_buffer.push_back(item);
 }
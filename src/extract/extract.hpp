@@ -23,6 +23,9 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 */
 
+#include "buffer_budget.hpp"
+#include "extract_state.hpp"
+
 #include "../option_clean.hpp"
 
 #include <osmium/io/file.hpp>
@@ -32,7 +35,11 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <osmium/memory/item.hpp>
 #include <osmium/osm/box.hpp>
 #include <osmium/osm/location.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/thread/pool.hpp>
 
+#include <cstddef>
+#include <limits>
 #include <memory>
 #include <string>
 #include <utility>
@@ -40,23 +47,51 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 class Extract {
 
-    static constexpr const std::size_t buffer_size = 10UL * 1024UL * 1024UL;
-
     osmium::io::File m_output_file;
     std::string m_description;
     std::vector<std::string> m_header_options;
     osmium::Box m_envelope;
-    osmium::memory::Buffer m_buffer{buffer_size, osmium::memory::Buffer::auto_grow::no};
+
+    // The buffer is only allocated when something is written to it and
+    // handed over to the writer when it is full, so extracts that don't
+    // get any data don't need any memory for it.
+    osmium::memory::Buffer m_buffer;
+    std::size_t m_buffer_size = default_buffer_size;
+
+    // If there is a budget, buffers start small and get larger (up to
+    // m_buffer_size) each time a buffer is full as long as the budget
+    // allows it. The memory for buffers of the current size is taken
+    // from the budget when the first buffer is allocated.
+    BufferBudget* m_budget = nullptr;
+    std::size_t m_current_buffer_size = 0;
     std::unique_ptr<osmium::io::Writer> m_writer;
     const OptionClean* m_clean = nullptr;
+    std::unique_ptr<ExtractState> m_state;
+    std::size_t m_parent;
+
+    void add_to_state(const osmium::memory::Item& item);
+
+    std::size_t next_buffer_size();
+
+    void flush_buffer();
 
 public:
 
+    /// The default size of the output buffer.
+    static constexpr const std::size_t default_buffer_size = 10UL * 1024UL * 1024UL;
+
+    /// The smallest size of the output buffer.
+    static constexpr const std::size_t min_buffer_size = 64UL * 1024UL;
+
+    /// Value returned by parent() if the extract doesn't have a parent.
+    static constexpr const std::size_t no_parent = std::numeric_limits<std::size_t>::max();
+
     Extract(const osmium::io::File& output_file, const std::string& description, const osmium::Box& envelope) :
         m_output_file(output_file),
         m_description(description),
         m_envelope(envelope),
-        m_writer(nullptr) {
+        m_writer(nullptr),
+        m_parent(no_parent) {
     }
 
     virtual ~Extract() = default;
@@ -65,6 +100,10 @@ public:
         return m_output_file.filename();
     }
 
+    bool output_is_change() const noexcept {
+        return m_output_file.is_change();
+    }
+
     const char* output_format() const noexcept {
         return osmium::io::as_string(m_output_file.format());
     }
@@ -77,6 +116,15 @@ public:
         return m_envelope;
     }
 
+    /**
+     * The envelopes of all parts of this extract. Usually this is only
+     * the envelope of the whole extract, but extracts crossing the
+     * antimeridian can have a separate envelope for each hemisphere.
+     */
+    virtual std::vector<osmium::Box> envelopes() const {
+        return {m_envelope};
+    }
+
     void add_header_option(const std::string& option) {
         m_header_options.emplace_back(option + "!");
     }
@@ -89,20 +137,87 @@ public:
         return m_header_options;
     }
 
+    /**
+     * Index of the parent extract in the list of extracts or no_parent.
+     * The extract must be completely inside its parent, only nodes inside
+     * the parent are checked against the extract.
+     */
+    std::size_t parent() const noexcept {
+        return m_parent;
+    }
+
+    void set_parent(std::size_t parent) noexcept {
+        m_parent = parent;
+    }
+
+    /**
+     * Set the state of this extract. From now on the IDs of all objects
+     * written to the extract are added to the state.
+     */
+    void set_state(std::unique_ptr<ExtractState>&& state) noexcept {
+        m_state = std::move(state);
+    }
+
+    /// The state of this extract or nullptr if there is none.
+    ExtractState* state() noexcept {
+        return m_state.get();
+    }
+
+    const ExtractState* state() const noexcept {
+        return m_state.get();
+    }
+
+    /// The largest size of the output buffer.
+    std::size_t buffer_size() const noexcept {
+        return m_buffer_size;
+    }
+
+    /// Set the largest size of the output buffer (at least min_buffer_size).
+    void set_buffer_size(std::size_t size) noexcept;
+
+    /**
+     * Take the memory for the output buffers from this budget, which is
+     * shared by all extracts. Without a budget the buffers always have
+     * the size set with set_buffer_size().
+     */
+    void set_buffer_budget(BufferBudget* budget) noexcept {
+        m_budget = budget;
+    }
+
     osmium::io::Writer& writer() {
         return *m_writer;
     }
 
-    void open_file(const osmium::io::Header& header, osmium::io::overwrite output_overwrite, osmium::io::fsync sync, OptionClean const* clean);
+    /**
+     * Open the output file. If pool is not nullptr, the writer uses the
+     * threads from that pool to encode the data, otherwise the default
+     * pool is used.
+     */
+    void open_file(const osmium::io::Header& header, osmium::io::overwrite output_overwrite, osmium::io::fsync sync, OptionClean const* clean, osmium::thread::Pool* pool = nullptr);
 
     void close_file();
 
+    /**
+     * Remember in the state (if there is one) that the node is inside the
+     * extract. The strategies call this for the nodes they found inside,
+     * so the location doesn't have to be checked again when the node is
+     * written.
+     */
+    void add_inside_node(const osmium::Node& node);
+
     void write(const osmium::memory::Item& item);
 
     std::string envelope_as_text() const;
 
     virtual bool contains(const osmium::Location& location) const noexcept = 0;
 
+    /**
+     * Check all locations at once. After the call results has the same
+     * size as locations and (*results)[n] is true if locations[n] is
+     * inside the extract.
+     */
+    virtual void contains_batch(const std::vector<osmium::Location>& locations, std::vector<bool>* results) const;
+
     virtual const char* geometry_type() const noexcept = 0;
 
     virtual std::string geometry_as_text() const = 0;
@@ -24,13 +24,22 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <osmium/osm/location.hpp>
 
+#include <cstddef>
 #include <iterator>
 #include <string>
+#include <vector>
 
 bool ExtractBBox::contains(const osmium::Location& location) const noexcept {
     return location.valid() && envelope().contains(location);
 }
 
+void ExtractBBox::contains_batch(const std::vector<osmium::Location>& locations, std::vector<bool>* results) const {
+    results->resize(locations.size());
+    for (std::size_t n = 0; n < locations.size(); ++n) {
+        (*results)[n] = contains(locations[n]);
+    }
+}
+
 const char* ExtractBBox::geometry_type() const noexcept {
     return "bbox";
 }
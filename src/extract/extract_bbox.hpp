@@ -25,6 +25,9 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "extract.hpp"
 
+#include <string>
+#include <vector>
+
 class ExtractBBox : public Extract {
 
 public:
@@ -35,6 +38,8 @@ public:
 
     bool contains(const osmium::Location& location) const noexcept override final;
 
+    void contains_batch(const std::vector<osmium::Location>& locations, std::vector<bool>* results) const override final;
+
     const char* geometry_type() const noexcept override final;
 
     std::string geometry_as_text() const override final;
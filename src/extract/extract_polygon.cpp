@@ -22,15 +22,22 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "extract_polygon.hpp"
 
+#include "crossing_kernel.hpp"
+
 #include "../exception.hpp"
 
 #include <osmium/geom/wkt.hpp>
+#include <osmium/osm/box.hpp>
 #include <osmium/osm/location.hpp>
 #include <osmium/osm/segment.hpp>
 
 #include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <numeric>
 #include <string>
 #include <utility>
 #include <vector>
@@ -52,54 +59,350 @@ void add_ring(std::vector<osmium::Segment>* segments, const osmium::NodeRefList&
     }
 }
 
+// Builds the tree of bands for a polygon part. Each node splits its y
+// range into sub-ranges of equal height, so that there are about
+// segments_per_band segments in each. Sub-ranges with more than
+// max_segments_per_band segments are split again. Segments spanning
+// several sub-ranges are in all of them, so a sub-range is not split if
+// that would mostly copy segments, which happens for long segments or
+// many segments with the same y range.
+class band_builder {
+
+    static constexpr const std::size_t segments_per_band = 10;
+    static constexpr const std::size_t max_segments_per_band = 4 * segments_per_band;
+    static constexpr const std::size_t max_bands = 10000;
+    static constexpr const int max_depth = 4;
+
+    const std::vector<osmium::Segment>& m_segments;
+    ExtractPolygon::prepared_data& m_part;
+    std::vector<std::vector<uint32_t>> m_bands;
+
+    uint32_t add_band(std::vector<uint32_t>&& ids) {
+        m_bands.push_back(std::move(ids));
+        return static_cast<uint32_t>(m_bands.size() - 1);
+    }
+
+    uint32_t add(int64_t y_min, int64_t height, std::vector<uint32_t>&& ids, int depth) {
+        const bool root = depth == 0;
+        auto num = static_cast<int64_t>(std::min(std::max(ids.size() / segments_per_band, std::size_t{1}), max_bands));
+        num = std::min(num, height + 1);
+
+        if (!root && (ids.size() <= max_segments_per_band || depth > max_depth || num < 2)) {
+            return add_band(std::move(ids));
+        }
+
+        const int64_t dy = height / num + 1;
+        std::vector<std::vector<uint32_t>> children(static_cast<std::size_t>(num));
+        std::size_t total = 0;
+        for (const auto id : ids) {
+            const auto& segment = m_segments[id];
+            const std::pair<int32_t, int32_t> mm = std::minmax(segment.first().y(), segment.second().y());
+            const auto first = std::max((mm.first - y_min) / dy, static_cast<int64_t>(0));
+            const auto last = std::min((mm.second - y_min) / dy, num - 1);
+            for (auto n = first; n <= last; ++n) {
+                children[static_cast<std::size_t>(n)].push_back(id);
+                ++total;
+            }
+        }
+
+        if (!root && total > 2 * ids.size()) {
+            return add_band(std::move(ids));
+        }
+
+        const auto node = static_cast<uint32_t>(m_part.band_nodes.size());
+        ExtractPolygon::band_node band_node;
+        band_node.y_min = static_cast<int32_t>(y_min);
+        band_node.dy = static_cast<int32_t>(dy);
+        band_node.first = static_cast<uint32_t>(m_part.band_children.size());
+        band_node.size = static_cast<uint32_t>(num);
+        m_part.band_nodes.push_back(band_node);
+        m_part.band_children.resize(m_part.band_children.size() + children.size());
+
+        for (std::size_t n = 0; n < children.size(); ++n) {
+            const auto child = add(y_min + static_cast<int64_t>(n) * dy, dy - 1, std::move(children[n]), depth + 1);
+            m_part.band_children[band_node.first + n] = child;
+        }
+
+        return node | ExtractPolygon::band_node_flag;
+    }
+
+public:
+
+    band_builder(const std::vector<osmium::Segment>& segments, ExtractPolygon::prepared_data* part) :
+        m_segments(segments),
+        m_part(*part) {
+    }
+
+    void operator()() {
+        const auto& envelope = m_part.envelope;
+        std::vector<uint32_t> ids(m_segments.size());
+        std::iota(ids.begin(), ids.end(), 0);
+        add(envelope.bottom_left().y(),
+            static_cast<int64_t>(envelope.top_right().y()) - envelope.bottom_left().y(),
+            std::move(ids), 0);
+
+        // put segments into the bands in structure-of-arrays layout
+        auto& offsets = m_part.band_offsets;
+        offsets.assign(m_bands.size() + 1, 0);
+        for (std::size_t band = 0; band < m_bands.size(); ++band) {
+            offsets[band + 1] = offsets[band] + m_bands[band].size();
+        }
+
+        const std::size_t total = offsets.back();
+        m_part.x1.resize(total);
+        m_part.y1.resize(total);
+        m_part.x2.resize(total);
+        m_part.y2.resize(total);
+        std::size_t n = 0;
+        for (const auto& band : m_bands) {
+            for (const auto id : band) {
+                const auto& segment = m_segments[id];
+                m_part.x1[n] = segment.first().x();
+                m_part.y1[n] = segment.first().y();
+                m_part.x2[n] = segment.second().x();
+                m_part.y2[n] = segment.second().y();
+                ++n;
+            }
+        }
+    }
+
+}; // class band_builder
+
 } // anonymous namespace
 
 const osmium::Area& ExtractPolygon::area() const noexcept {
     return m_buffer.get<osmium::Area>(m_offset);
 }
 
-ExtractPolygon::ExtractPolygon(const osmium::io::File& output_file, const std::string& description, const osmium::memory::Buffer& buffer, std::size_t offset) :
+ExtractPolygon::ExtractPolygon(const osmium::io::File& output_file, const std::string& description, const osmium::memory::Buffer& buffer, std::size_t offset, int raster_size) :
     Extract(output_file, description, buffer.get<osmium::Area>(offset).envelope()),
     m_buffer(buffer),
     m_offset(offset) {
 
+    // If the envelope is wider than half the globe, the polygon probably
+    // crosses the antimeridian. Then each outer ring together with its
+    // inner rings goes into the part for the hemisphere the center of
+    // the outer ring is in.
+    constexpr const int64_t max_width = 180LL * osmium::detail::coordinate_precision;
+    const bool split = envelope().valid() &&
+                       static_cast<int64_t>(envelope().top_right().x()) - envelope().bottom_left().x() > max_width;
+
     // get segments from all rings
-    std::vector<osmium::Segment> segments;
+    std::array<std::vector<osmium::Segment>, 2> segments;
+    std::array<osmium::Box, 2> envelopes;
     for (const auto& outer_ring : area().outer_rings()) {
-        add_ring(&segments, outer_ring);
+        const osmium::Box ring_envelope = outer_ring.envelope();
+        std::size_t n = 0;
+        if (split && static_cast<int64_t>(ring_envelope.bottom_left().x()) + ring_envelope.top_right().x() < 0) {
+            n = 1;
+        }
+
+        add_ring(&segments[n], outer_ring);
+        envelopes[n].extend(ring_envelope);
 
         for (const auto& inner_ring : area().inner_rings(outer_ring)) {
-            add_ring(&segments, inner_ring);
+            add_ring(&segments[n], inner_ring);
+            envelopes[n].extend(inner_ring.envelope());
+        }
+    }
+
+    for (std::size_t n = 0; n < segments.size(); ++n) {
+        if (segments[n].empty()) {
+            continue;
+        }
+
+        prepared_data part;
+        part.envelope = envelopes[n];
+        build_bands(&part, segments[n]);
+
+        // A raster only pays off for parts with many segments.
+        int part_raster_size = raster_size;
+        if (part_raster_size == raster_size_auto) {
+            constexpr const std::size_t min_segments_for_raster = 100;
+            constexpr const std::size_t max_auto_raster_size = 512;
+            part_raster_size = 0;
+            if (segments[n].size() >= min_segments_for_raster) {
+                const auto size = static_cast<std::size_t>(2.0 * std::sqrt(static_cast<double>(segments[n].size())));
+                part_raster_size = static_cast<int>(std::min(size, max_auto_raster_size));
+            }
+        }
+
+        if (part_raster_size > 0) {
+            build_raster(&part, segments[n], static_cast<std::size_t>(std::min(part_raster_size, max_raster_size)));
         }
+
+        m_parts.push_back(std::move(part));
     }
+}
+
+ExtractPolygon::ExtractPolygon(const osmium::io::File& output_file, const std::string& description, const osmium::memory::Buffer& buffer, std::size_t offset, std::vector<prepared_data>&& parts) :
+    Extract(output_file, description, buffer.get<osmium::Area>(offset).envelope()),
+    m_buffer(buffer),
+    m_offset(offset),
+    m_parts(std::move(parts)) {
 
-    // split y range into equal-sized bands
-    constexpr const int32_t segments_per_band = 10;
-    constexpr const int32_t max_bands = 10000;
-    int32_t num_bands = static_cast<int32_t>(segments.size()) / segments_per_band;
-    if (num_bands < 1) {
-        num_bands = 1;
-    } else if (num_bands > max_bands) {
-        num_bands = max_bands;
+    for (const auto& part : m_parts) {
+        if (!valid(part)) {
+            throw config_error{"Invalid prepared polygon data."};
+        }
     }
+}
 
-    m_bands.resize(num_bands + 1);
+void ExtractPolygon::build_bands(prepared_data* part, const std::vector<osmium::Segment>& segments) {
+    band_builder builder{segments, part};
+    builder();
+}
 
-    m_dy = (y_max() - y_min() + num_bands - 1) / num_bands;
+bool ExtractPolygon::valid(const prepared_data& part) noexcept {
+    if (!part.envelope.valid() ||
+        part.band_nodes.empty() || part.band_offsets.empty() ||
+        part.band_offsets.back() != part.x1.size() ||
+        part.x1.size() != part.y1.size() || part.x1.size() != part.x2.size() || part.x1.size() != part.y2.size() ||
+        part.raster.size() != part.raster_size * part.raster_size ||
+        part.cell_width <= 0 || part.cell_height <= 0) {
+        return false;
+    }
 
-    // put segments into the bands they overlap
+    // Child nodes always come after their parents, so there can't be
+    // any loops.
+    for (std::size_t n = 0; n < part.band_nodes.size(); ++n) {
+        const auto& node = part.band_nodes[n];
+        if (node.dy <= 0 || node.size == 0 || node.first > part.band_children.size() ||
+            node.size > part.band_children.size() - node.first) {
+            return false;
+        }
+        for (auto i = node.first; i < node.first + node.size; ++i) {
+            const auto child = part.band_children[i];
+            if (child & band_node_flag) {
+                const auto index = child & ~band_node_flag;
+                if (index <= n || index >= part.band_nodes.size()) {
+                    return false;
+                }
+            } else if (child + 1 >= part.band_offsets.size()) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+std::size_t ExtractPolygon::raster_column(const prepared_data& part, int64_t x) noexcept {
+    const auto column = (x - part.envelope.bottom_left().x()) / part.cell_width;
+    return static_cast<std::size_t>(std::max(std::min(column, static_cast<int64_t>(part.raster_size) - 1), static_cast<int64_t>(0)));
+}
+
+std::size_t ExtractPolygon::raster_row(const prepared_data& part, int64_t y) noexcept {
+    const auto row = (y - part.envelope.bottom_left().y()) / part.cell_height;
+    return static_cast<std::size_t>(std::max(std::min(row, static_cast<int64_t>(part.raster_size) - 1), static_cast<int64_t>(0)));
+}
+
+void ExtractPolygon::build_raster(prepared_data* part, const std::vector<osmium::Segment>& segments, std::size_t raster_size) {
+    const int64_t x_min = part->envelope.bottom_left().x();
+    const int64_t y_min = part->envelope.bottom_left().y();
+    const int64_t x_max = part->envelope.top_right().x();
+    const int64_t y_max = part->envelope.top_right().y();
+
+    part->raster_size = raster_size;
+    const auto size = static_cast<int64_t>(raster_size);
+    part->cell_width = static_cast<int32_t>((x_max - x_min + size) / size);
+    part->cell_height = static_cast<int32_t>((y_max - y_min + size) / size);
+
+    auto& raster = part->raster;
+    raster.assign(raster_size * raster_size, cell_type::outside);
+
+    // Mark all cells touched by a segment as boundary cells. For each row
+    // of cells the segment passes through, the x range of the part of the
+    // segment inside that row is calculated. One extra cell on each side
+    // makes sure rounding errors don't matter.
     for (const auto& segment : segments) {
-        const std::pair<int32_t, int32_t> mm = std::minmax(segment.first().y(), segment.second().y());
-        const uint32_t band_min = (mm.first - y_min()) / m_dy;
-        const uint32_t band_max = (mm.second - y_min()) / m_dy;
-        assert(band_min < m_bands.size() && band_max < m_bands.size());
+        const double x1 = segment.first().x();
+        const double y1 = segment.first().y();
+        const double x2 = segment.second().x();
+        const double y2 = segment.second().y();
+        const auto row_min = raster_row(*part, std::min(segment.first().y(), segment.second().y()));
+        const auto row_max = raster_row(*part, std::max(segment.first().y(), segment.second().y()));
+
+        for (auto row = row_min; row <= row_max; ++row) {
+            double xa = x1;
+            double xb = x2;
+            if (y1 != y2) {
+                const double row_bottom = static_cast<double>(y_min) + static_cast<double>(row) * part->cell_height;
+                const double row_top = row_bottom + part->cell_height;
+                const double ya = std::max(std::min(y1, y2), row_bottom);
+                const double yb = std::min(std::max(y1, y2), row_top);
+                xa = x1 + (x2 - x1) * (ya - y1) / (y2 - y1);
+                xb = x1 + (x2 - x1) * (yb - y1) / (y2 - y1);
+            }
+            auto col_min = raster_column(*part, static_cast<int64_t>(std::floor(std::min(xa, xb))));
+            auto col_max = raster_column(*part, static_cast<int64_t>(std::ceil(std::max(xa, xb))));
+            col_min = col_min > 0 ? col_min - 1 : 0;
+            col_max = std::min(col_max + 1, raster_size - 1);
+            for (auto col = col_min; col <= col_max; ++col) {
+                raster[row * raster_size + col] = cell_type::boundary;
+            }
+        }
+    }
 
-        for (auto band = band_min; band <= band_max; ++band) {
-            m_bands[band].push_back(segment);
+    // All other cells are completely inside or outside the part. Going
+    // along each row, this only changes after boundary cells, so only
+    // the first cell after a run of boundary cells has to be checked.
+    for (std::size_t row = 0; row < raster_size; ++row) {
+        bool known = false;
+        cell_type type = cell_type::outside;
+        const int64_t y = std::min(y_min + static_cast<int64_t>(row) * part->cell_height + part->cell_height / 2, y_max);
+        for (std::size_t col = 0; col < raster_size; ++col) {
+            auto& cell = raster[row * raster_size + col];
+            if (cell == cell_type::boundary) {
+                known = false;
+                continue;
+            }
+            if (!known) {
+                const int64_t x = std::min(x_min + static_cast<int64_t>(col) * part->cell_width + part->cell_width / 2, x_max);
+                const osmium::Location center{static_cast<int32_t>(x), static_cast<int32_t>(y)};
+                type = contains_in_bands(*part, center) ? cell_type::inside : cell_type::outside;
+                known = true;
+            }
+            cell = type;
         }
     }
 }
 
+std::size_t ExtractPolygon::raster_size() const noexcept {
+    std::size_t size = 0;
+    for (const auto& part : m_parts) {
+        size = std::max(size, part.raster_size);
+    }
+    return size;
+}
+
+std::size_t ExtractPolygon::raster_boundary_cells() const noexcept {
+    std::size_t count = 0;
+    for (const auto& part : m_parts) {
+        count += static_cast<std::size_t>(std::count(part.raster.cbegin(), part.raster.cend(), cell_type::boundary));
+    }
+    return count;
+}
+
+std::size_t ExtractPolygon::max_band_segments() const noexcept {
+    std::size_t max = 0;
+    for (const auto& part : m_parts) {
+        for (std::size_t band = 0; band + 1 < part.band_offsets.size(); ++band) {
+            max = std::max(max, part.band_offsets[band + 1] - part.band_offsets[band]);
+        }
+    }
+    return max;
+}
+
+std::vector<osmium::Box> ExtractPolygon::envelopes() const {
+    std::vector<osmium::Box> result;
+    result.reserve(m_parts.size());
+    for (const auto& part : m_parts) {
+        result.push_back(part.envelope);
+    }
+    return result;
+}
+
 /*
 
   Simple point-in-polygon algorithm adapted from
@@ -117,9 +420,9 @@ ExtractPolygon::ExtractPolygon(const osmium::io::File& output_file, const std::s
         return c;
     }
 
-  In our implementation we split the y-range into equal-sized subranges and
-  only have to test all segments in the subrange that contains the y coordinate
-  of the node.
+  In our implementation we split the y-range into subranges (bands) and only
+  have to test all segments in the band that contains the y coordinate of the
+  node. The bands are smaller where there are more segments.
 
 */
 
@@ -128,31 +431,56 @@ bool ExtractPolygon::contains(const osmium::Location& location) const noexcept {
         return false;
     }
 
-    const std::size_t band = (location.y() - y_min()) / m_dy;
-    assert(band < m_bands.size());
-
     bool inside = false;
-
-    for (const auto& segment : m_bands[band]) {
-        if (segment.first() == location || segment.second() == location) {
-            return true;
+    for (const auto& part : m_parts) {
+        if (part.envelope.contains(location) && contains_in_part(part, location)) {
+            inside = !inside;
         }
-        if ((segment.second().y() > location.y()) != (segment.first().y() > location.y())) {
-            const auto ax = static_cast<int64_t>(segment.first().x()) - static_cast<int64_t>(segment.second().x());
-            const auto ay = static_cast<int64_t>(segment.first().y()) - static_cast<int64_t>(segment.second().y());
-            const auto tx = static_cast<int64_t>(location.x())        - static_cast<int64_t>(segment.second().x());
-            const auto ty = static_cast<int64_t>(location.y())        - static_cast<int64_t>(segment.second().y());
+    }
 
-            const bool comp = tx * ay < ax * ty;
+    return inside;
+}
 
-            if ((ay > 0) == comp) {
-                inside = !inside;
-            }
+void ExtractPolygon::contains_batch(const std::vector<osmium::Location>& locations, std::vector<bool>* results) const {
+    results->resize(locations.size());
+    for (std::size_t n = 0; n < locations.size(); ++n) {
+        (*results)[n] = contains(locations[n]);
+    }
+}
+
+bool ExtractPolygon::contains_in_part(const prepared_data& part, const osmium::Location& location) noexcept {
+    if (!part.raster.empty()) {
+        const auto cell = part.raster[raster_row(part, location.y()) * part.raster_size + raster_column(part, location.x())];
+        if (cell != cell_type::boundary) {
+            return cell == cell_type::inside;
         }
+    }
 
+    return contains_in_bands(part, location);
+}
+
+bool ExtractPolygon::contains_in_bands(const prepared_data& part, const osmium::Location& location) noexcept {
+    const band_node* node = &part.band_nodes.front();
+    uint32_t band = 0;
+    while (true) {
+        const std::size_t n = (location.y() - node->y_min) / node->dy;
+        assert(n < node->size);
+        band = part.band_children[node->first + n];
+        if (!(band & band_node_flag)) {
+            break;
+        }
+        node = &part.band_nodes[band & ~band_node_flag];
     }
+    assert(band + 1 < part.band_offsets.size());
 
-    return inside;
+    const std::size_t begin = part.band_offsets[band];
+    const band_segments segments{part.x1.data() + begin,
+                                 part.y1.data() + begin,
+                                 part.x2.data() + begin,
+                                 part.y2.data() + begin,
+                                 part.band_offsets[band + 1] - begin};
+
+    return location_in_band(segments, location.x(), location.y());
 }
 
 const char* ExtractPolygon::geometry_type() const noexcept {
@@ -163,4 +491,3 @@ std::string ExtractPolygon::geometry_as_text() const {
     osmium::geom::WKTFactory<> factory;
     return factory.create_multipolygon(area());
 }
-
@@ -26,34 +26,143 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "extract.hpp"
 
 #include <osmium/osm/area.hpp>
+#include <osmium/osm/box.hpp>
 #include <osmium/osm/segment.hpp>
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 class ExtractPolygon : public Extract {
 
+public:
+
+    enum class cell_type : uint8_t {
+        outside  = 0,
+        inside   = 1,
+        boundary = 2
+    };
+
+    /**
+     * A node in the tree of bands. It splits the y range starting at
+     * y_min into size sub-ranges of height dy. The entries in
+     * band_children from first to first + size say for each sub-range
+     * if it is a band (the band index) or split further (the node index
+     * with band_node_flag set).
+     */
+    struct band_node {
+        int32_t y_min = 0;
+        int32_t dy = 1;
+        uint32_t first = 0;
+        uint32_t size = 0;
+    };
+
+    static constexpr const uint32_t band_node_flag = 0x80000000U;
+
+    /**
+     * The acceleration structures built from the segments of one part of
+     * the polygon. They can be taken out of an ExtractPolygon and used to
+     * create another one for the same polygon without having to build
+     * them again.
+     */
+    struct prepared_data {
+        // Envelope of all rings in this part.
+        osmium::Box envelope;
+
+        // Tree of bands, the first node is the root. Where there are many
+        // segments the bands are smaller, so no band has many more
+        // segments than others.
+        std::vector<band_node> band_nodes;
+        std::vector<uint32_t> band_children;
+
+        // Segments of all bands in structure-of-arrays layout. The
+        // segments of band n are the ones from band_offsets[n] to
+        // band_offsets[n+1].
+        std::vector<std::size_t> band_offsets;
+        std::vector<int32_t> x1;
+        std::vector<int32_t> y1;
+        std::vector<int32_t> x2;
+        std::vector<int32_t> y2;
+
+        // Raster of raster_size x raster_size cells over the envelope.
+        // Cells that no segment touches are completely inside or outside
+        // of the part, only locations in boundary cells have to be
+        // checked against the segments.
+        std::vector<cell_type> raster;
+        std::size_t raster_size = 0;
+        int32_t cell_width = 1;
+        int32_t cell_height = 1;
+    };
+
+private:
+
     const osmium::memory::Buffer& m_buffer;
     std::size_t m_offset;
 
-    std::vector<std::vector<osmium::Segment>> m_bands;
-    int32_t m_dy = 0;
+    // Polygons crossing the antimeridian have an envelope spanning the
+    // whole globe. They are split into one part for each hemisphere, so
+    // each part has a small envelope and bands. All other polygons have
+    // only one part. Because all rings are closed, a location is in the
+    // polygon if it is in an odd number of parts.
+    std::vector<prepared_data> m_parts;
 
     const osmium::Area& area() const noexcept;
 
-    int32_t y_max() const noexcept {
-        return envelope().top_right().y();
+    static std::size_t raster_column(const prepared_data& part, int64_t x) noexcept;
+
+    static std::size_t raster_row(const prepared_data& part, int64_t y) noexcept;
+
+    static void build_bands(prepared_data* part, const std::vector<osmium::Segment>& segments);
+
+    static bool valid(const prepared_data& part) noexcept;
+
+    static void build_raster(prepared_data* part, const std::vector<osmium::Segment>& segments, std::size_t raster_size);
+
+    static bool contains_in_part(const prepared_data& part, const osmium::Location& location) noexcept;
+
+    static bool contains_in_bands(const prepared_data& part, const osmium::Location& location) noexcept;
+
+public:
+
+    /// Use this as raster size to choose one based on the number of segments.
+    static constexpr const int raster_size_auto = -1;
+
+    /// The largest raster size allowed.
+    static constexpr const int max_raster_size = 4096;
+
+    ExtractPolygon(const osmium::io::File& output_file, const std::string& description, const osmium::memory::Buffer& buffer, std::size_t offset, int raster_size = raster_size_auto);
+
+    /**
+     * Create polygon extract from data prepared earlier by another
+     * ExtractPolygon for the same polygon.
+     */
+    ExtractPolygon(const osmium::io::File& output_file, const std::string& description, const osmium::memory::Buffer& buffer, std::size_t offset, std::vector<prepared_data>&& parts);
+
+    /// Get a copy of the acceleration structures of all parts.
+    std::vector<prepared_data> prepared() const {
+        return m_parts;
     }
 
-    int32_t y_min() const noexcept {
-        return envelope().bottom_left().y();
+    /// Number of parts the polygon was split into.
+    std::size_t parts() const noexcept {
+        return m_parts.size();
     }
 
-public:
+    /// Largest number of raster cells in each direction in any part (0 if there is no raster).
+    std::size_t raster_size() const noexcept;
+
+    /// Number of raster cells on the boundary of the polygon.
+    std::size_t raster_boundary_cells() const noexcept;
 
-    ExtractPolygon(const osmium::io::File& output_file, const std::string& description, const osmium::memory::Buffer& buffer, std::size_t offset);
+    /// Largest number of segments in any band.
+    std::size_t max_band_segments() const noexcept;
+
+    std::vector<osmium::Box> envelopes() const override final;
 
     bool contains(const osmium::Location& location) const noexcept override final;
 
+    void contains_batch(const std::vector<osmium::Location>& locations, std::vector<bool>* results) const override final;
+
     const char* geometry_type() const noexcept override final;
 
     std::string geometry_as_text() const override final;
@@ -0,0 +1,220 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "extract_state.hpp"
+
+#include <osmium/io/error.hpp>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr const char state_magic[8] = {'O', 'S', 'M', 'X', 'S', 'T', 'A', 'T'};
+constexpr const uint32_t state_version = 1;
+
+// The ID sets are written as a count followed by the differences between
+// consecutive IDs encoded as varints, so dense sets need about one byte
+// per ID.
+void add_varint(std::string* out, uint64_t value) {
+    while (value >= 0x80U) {
+        out->push_back(static_cast<char>((value & 0x7fU) | 0x80U));
+        value >>= 7U;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+class state_file_writer {
+
+    static constexpr const std::size_t flush_size = 1024UL * 1024UL;
+
+    std::string m_filename;
+    std::ofstream m_file;
+    std::string m_data;
+
+public:
+
+    explicit state_file_writer(const std::string& filename) :
+        m_filename(filename),
+        m_file(filename, std::ios::binary | std::ios::trunc) {
+        if (!m_file) {
+            throw std::system_error{errno, std::system_category(), "Could not open state file '" + m_filename + "'"};
+        }
+    }
+
+    void flush() {
+        m_file.write(m_data.data(), static_cast<std::streamsize>(m_data.size()));
+        if (!m_file) {
+            throw std::system_error{errno, std::system_category(), "Could not write state file '" + m_filename + "'"};
+        }
+        m_data.clear();
+    }
+
+    void write_bytes(const char* data, std::size_t size) {
+        m_data.append(data, size);
+    }
+
+    void write_varint(uint64_t value) {
+        add_varint(&m_data, value);
+        if (m_data.size() >= flush_size) {
+            flush();
+        }
+    }
+
+    void write_id_set(const CompressedIdSet& ids) {
+        write_varint(ids.size());
+        CompressedIdSet::id_type last = 0;
+        ids.for_each([&](CompressedIdSet::id_type id) {
+            write_varint(id - last);
+            last = id;
+        });
+    }
+
+    void close() {
+        flush();
+        m_file.close();
+        if (!m_file) {
+            throw std::system_error{errno, std::system_category(), "Could not write state file '" + m_filename + "'"};
+        }
+    }
+
+}; // class state_file_writer
+
+class state_file_reader {
+
+    std::string m_filename;
+    std::string m_data;
+    const char* m_pos = nullptr;
+    const char* m_end = nullptr;
+
+    [[noreturn]] void error() const {
+        throw osmium::io_error{"Invalid state file '" + m_filename + "'."};
+    }
+
+public:
+
+    explicit state_file_reader(const std::string& filename) :
+        m_filename(filename) {
+        std::ifstream file{filename, std::ios::binary};
+        if (!file) {
+            throw osmium::io_error{"Could not open state file '" + filename + "'."};
+        }
+        m_data.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+        m_pos = m_data.data();
+        m_end = m_data.data() + m_data.size();
+    }
+
+    void read_bytes(char* data, std::size_t size) {
+        if (size > static_cast<std::size_t>(m_end - m_pos)) {
+            error();
+        }
+        std::memcpy(data, m_pos, size);
+        m_pos += size;
+    }
+
+    uint64_t read_varint() {
+        uint64_t value = 0;
+        unsigned int shift = 0;
+        while (m_pos != m_end && shift < 64) {
+            const auto byte = static_cast<unsigned char>(*m_pos++);
+            value |= static_cast<uint64_t>(byte & 0x7fU) << shift;
+            if ((byte & 0x80U) == 0) {
+                return value;
+            }
+            shift += 7;
+        }
+        error();
+    }
+
+    void read_id_set(CompressedIdSet* ids) {
+        const auto count = read_varint();
+        CompressedIdSet::id_type id = 0;
+        for (uint64_t n = 0; n < count; ++n) {
+            id += read_varint();
+            ids->set(id);
+        }
+    }
+
+    void check_end() const {
+        if (m_pos != m_end) {
+            error();
+        }
+    }
+
+}; // class state_file_reader
+
+} // anonymous namespace
+
+void write_state_file(const std::string& filename, const std::vector<const ExtractState*>& states) {
+    state_file_writer writer{filename};
+
+    writer.write_bytes(state_magic, sizeof(state_magic));
+    writer.write_varint(state_version);
+    writer.write_varint(states.size());
+
+    for (const auto* state : states) {
+        writer.write_id_set(state->inside_nodes());
+        writer.write_id_set(state->nodes());
+        writer.write_id_set(state->ways());
+        writer.write_id_set(state->relations());
+    }
+
+    writer.close();
+}
+
+std::vector<std::unique_ptr<ExtractState>> read_state_file(const std::string& filename) {
+    state_file_reader reader{filename};
+
+    char magic[sizeof(state_magic)];
+    reader.read_bytes(magic, sizeof(magic));
+    if (std::memcmp(magic, state_magic, sizeof(magic)) != 0) {
+        throw osmium::io_error{"File '" + filename + "' is not a state file."};
+    }
+
+    if (reader.read_varint() != state_version) {
+        throw osmium::io_error{"Unsupported version of state file '" + filename + "'."};
+    }
+
+    std::vector<std::unique_ptr<ExtractState>> states;
+    const auto count = reader.read_varint();
+    for (uint64_t n = 0; n < count; ++n) {
+        auto state = std::make_unique<ExtractState>();
+        reader.read_id_set(&state->inside_nodes());
+        reader.read_id_set(&state->nodes());
+        reader.read_id_set(&state->ways());
+        reader.read_id_set(&state->relations());
+        states.push_back(std::move(state));
+    }
+
+    reader.check_end();
+
+    return states;
+}
@@ -0,0 +1,102 @@
+#ifndef EXTRACT_EXTRACT_STATE_HPP
+#define EXTRACT_EXTRACT_STATE_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "id_set.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * The IDs of all objects in an extract. This is collected while writing
+ * the extract and can be saved to a state file. When the extract is later
+ * updated from a change file, the state tells us which objects are in the
+ * extract without having to read it.
+ */
+class ExtractState {
+
+    // Nodes inside the extract geometry. Ways and relations are added
+    // to the extract because of these nodes.
+    CompressedIdSet m_inside_nodes;
+
+    // All nodes in the extract, including nodes outside the extract
+    // geometry that are needed to complete ways.
+    CompressedIdSet m_nodes;
+
+    CompressedIdSet m_ways;
+    CompressedIdSet m_relations;
+
+public:
+
+    CompressedIdSet& inside_nodes() noexcept {
+        return m_inside_nodes;
+    }
+
+    const CompressedIdSet& inside_nodes() const noexcept {
+        return m_inside_nodes;
+    }
+
+    CompressedIdSet& nodes() noexcept {
+        return m_nodes;
+    }
+
+    const CompressedIdSet& nodes() const noexcept {
+        return m_nodes;
+    }
+
+    CompressedIdSet& ways() noexcept {
+        return m_ways;
+    }
+
+    const CompressedIdSet& ways() const noexcept {
+        return m_ways;
+    }
+
+    CompressedIdSet& relations() noexcept {
+        return m_relations;
+    }
+
+    const CompressedIdSet& relations() const noexcept {
+        return m_relations;
+    }
+
+}; // class ExtractState
+
+/**
+ * Write the states of all extracts to a state file.
+ *
+ * @throws std::system_error if the file can not be written.
+ */
+void write_state_file(const std::string& filename, const std::vector<const ExtractState*>& states);
+
+/**
+ * Read the states of all extracts from a state file written with
+ * write_state_file().
+ *
+ * @throws osmium::io_error if the file can not be read or is invalid.
+ */
+std::vector<std::unique_ptr<ExtractState>> read_state_file(const std::string& filename);
+
+#endif // EXTRACT_EXTRACT_STATE_HPP
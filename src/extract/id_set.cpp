@@ -0,0 +1,300 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "id_set.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+CompressedIdSet::CompressedIdSet(CompressedIdSet&& other) noexcept :
+    m_containers(std::move(other.m_containers)),
+    m_size(other.m_size) {
+    other.m_containers.clear();
+    other.m_size = 0;
+    other.m_last_container = nullptr;
+}
+
+CompressedIdSet& CompressedIdSet::operator=(CompressedIdSet&& other) noexcept {
+    if (this != &other) {
+        m_containers = std::move(other.m_containers);
+        m_size = other.m_size;
+        m_last_container = nullptr;
+        other.m_containers.clear();
+        other.m_size = 0;
+        other.m_last_container = nullptr;
+    }
+    return *this;
+}
+
+const CompressedIdSet::container* CompressedIdSet::find_container(id_type key) const noexcept {
+    if (m_last_container && m_last_key == key) {
+        return m_last_container;
+    }
+
+    const auto it = m_containers.find(key);
+    if (it == m_containers.end()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+CompressedIdSet::container& CompressedIdSet::get_container(id_type key) {
+    if (m_last_container && m_last_key == key) {
+        return *m_last_container;
+    }
+
+    // IDs are usually added in order, so the new container is often last.
+    // Otherwise look up the key first, emplace_hint() would allocate a
+    // map node even if the key is already there.
+    auto it = m_containers.end();
+    if (m_containers.empty() || m_containers.rbegin()->first < key) {
+        it = m_containers.emplace_hint(it, key, container{});
+    } else {
+        it = m_containers.lower_bound(key);
+        if (it == m_containers.end() || it->first != key) {
+            it = m_containers.emplace_hint(it, key, container{});
+        }
+    }
+
+    m_last_key = key;
+    m_last_container = &it->second;
+    return it->second;
+}
+
+// Find the first run whose last ID is not smaller than value.
+std::size_t CompressedIdSet::first_run(const container& c, uint32_t value) noexcept {
+    assert(c.type == container_type::run);
+
+    std::size_t lo = 0;
+    std::size_t hi = c.values.size() / 2;
+    while (lo < hi) {
+        const std::size_t mid = (lo + hi) / 2;
+        if (c.values[mid * 2 + 1] < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool CompressedIdSet::container_get(const container& c, uint16_t value) noexcept {
+    switch (c.type) {
+        case container_type::array:
+            return std::binary_search(c.values.begin(), c.values.end(), value);
+        case container_type::bitmap:
+            return (c.bits[value / 64] & (1ULL << (value % 64))) != 0;
+        case container_type::run:
+            break;
+    }
+
+    const std::size_t n = first_run(c, value);
+    return n < c.values.size() / 2 && c.values[n * 2] <= value;
+}
+
+bool CompressedIdSet::container_set(container* c, uint16_t value) {
+    switch (c->type) {
+        case container_type::array: {
+            if (c->values.empty() || c->values.back() < value) {
+                c->values.push_back(value);
+            } else {
+                const auto it = std::lower_bound(c->values.begin(), c->values.end(), value);
+                if (*it == value) {
+                    return false;
+                }
+                c->values.insert(it, value);
+            }
+            if (c->values.size() > max_array_values) {
+                array_to_bitmap_or_runs(c);
+            }
+            return true;
+        }
+        case container_type::bitmap: {
+            auto& word = c->bits[value / 64];
+            const uint64_t bit = 1ULL << (value % 64);
+            if (word & bit) {
+                return false;
+            }
+            word |= bit;
+            return true;
+        }
+        case container_type::run:
+            break;
+    }
+
+    auto& runs = c->values;
+    const std::size_t num_runs = runs.size() / 2;
+    const std::size_t n = first_run(*c, value);
+
+    if (n < num_runs && runs[n * 2] <= value) {
+        return false;
+    }
+
+    const bool extends_previous = n > 0 && runs[n * 2 - 1] + 1 == value;
+    const bool extends_next = n < num_runs && runs[n * 2] == value + 1;
+
+    if (extends_previous && extends_next) {
+        runs[n * 2 - 1] = runs[n * 2 + 1];
+        runs.erase(runs.begin() + static_cast<std::ptrdiff_t>(n * 2), runs.begin() + static_cast<std::ptrdiff_t>(n * 2 + 2));
+    } else if (extends_previous) {
+        runs[n * 2 - 1] = value;
+    } else if (extends_next) {
+        runs[n * 2] = value;
+    } else {
+        const uint16_t run[2] = {value, value};
+        runs.insert(runs.begin() + static_cast<std::ptrdiff_t>(n * 2), run, run + 2);
+        if (runs.size() > max_array_values) {
+            runs_to_bitmap(c);
+        }
+    }
+
+    return true;
+}
+
+bool CompressedIdSet::container_next(const container& c, uint32_t value, uint16_t* result) noexcept {
+    switch (c.type) {
+        case container_type::array: {
+            const auto it = std::lower_bound(c.values.begin(), c.values.end(), value);
+            if (it == c.values.end()) {
+                return false;
+            }
+            *result = *it;
+            return true;
+        }
+        case container_type::bitmap: {
+            for (uint32_t word = value / 64; word < bitmap_words; ++word) {
+                uint64_t bits = c.bits[word];
+                if (word == value / 64) {
+                    bits &= ~0ULL << (value % 64);
+                }
+                if (bits != 0) {
+                    uint32_t bit = 0;
+                    while ((bits & 1U) == 0) {
+                        bits >>= 1U;
+                        ++bit;
+                    }
+                    *result = static_cast<uint16_t>(word * 64 + bit);
+                    return true;
+                }
+            }
+            return false;
+        }
+        case container_type::run:
+            break;
+    }
+
+    const std::size_t n = first_run(c, value);
+    if (n == c.values.size() / 2) {
+        return false;
+    }
+    *result = static_cast<uint16_t>(std::max(static_cast<uint32_t>(c.values[n * 2]), value));
+    return true;
+}
+
+void CompressedIdSet::array_to_bitmap_or_runs(container* c) {
+    assert(c->type == container_type::array);
+
+    std::vector<uint16_t> runs;
+    for (const auto value : c->values) {
+        if (!runs.empty() && runs.back() + 1 == value) {
+            runs.back() = value;
+        } else {
+            if (runs.size() >= max_array_values) {
+                runs.clear();
+                break;
+            }
+            runs.push_back(value);
+            runs.push_back(value);
+        }
+    }
+
+    if (!runs.empty()) {
+        c->values = std::move(runs);
+        c->type = container_type::run;
+        return;
+    }
+
+    c->bits.assign(bitmap_words, 0);
+    for (const auto value : c->values) {
+        c->bits[value / 64] |= 1ULL << (value % 64);
+    }
+    c->values = std::vector<uint16_t>{};
+    c->type = container_type::bitmap;
+}
+
+void CompressedIdSet::runs_to_bitmap(container* c) {
+    assert(c->type == container_type::run);
+
+    c->bits.assign(bitmap_words, 0);
+    for (std::size_t n = 0; n < c->values.size(); n += 2) {
+        for (uint32_t value = c->values[n]; value <= c->values[n + 1]; ++value) {
+            c->bits[value / 64] |= 1ULL << (value % 64);
+        }
+    }
+    c->values = std::vector<uint16_t>{};
+    c->type = container_type::bitmap;
+}
+
+bool CompressedIdSet::get(id_type id) const noexcept {
+    const container* c = find_container(id >> chunk_bits);
+    return c && container_get(*c, static_cast<uint16_t>(id & chunk_mask));
+}
+
+void CompressedIdSet::set(id_type id) {
+    if (container_set(&get_container(id >> chunk_bits), static_cast<uint16_t>(id & chunk_mask))) {
+        ++m_size;
+    }
+}
+
+bool CompressedIdSet::next(id_type* id) const noexcept {
+    const id_type key = *id >> chunk_bits;
+    uint32_t value = static_cast<uint32_t>(*id & chunk_mask);
+
+    for (auto it = m_containers.lower_bound(key); it != m_containers.end(); ++it) {
+        if (it->first != key) {
+            value = 0;
+        }
+        uint16_t result = 0;
+        if (container_next(it->second, value, &result)) {
+            *id = (it->first << chunk_bits) | result;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::size_t CompressedIdSet::used_memory() const noexcept {
+    // estimate for the map node overhead
+    constexpr const std::size_t node_overhead = 4 * sizeof(void*);
+
+    std::size_t memory = 0;
+    for (const auto& c : m_containers) {
+        memory += sizeof(c) + node_overhead;
+        memory += c.second.values.capacity() * sizeof(uint16_t) + c.second.bits.capacity() * sizeof(uint64_t);
+    }
+    return memory;
+}
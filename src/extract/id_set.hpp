@@ -0,0 +1,281 @@
+#ifndef EXTRACT_ID_SET_HPP
+#define EXTRACT_ID_SET_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/index/id_set.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+/**
+ * Set of IDs which only needs memory in proportion to the number of IDs
+ * in it. The ID space is divided into chunks of 2^16 IDs. Each chunk
+ * that contains any IDs has a container which is either a sorted array
+ * of the IDs, a bitmap, or a sorted list of runs of consecutive IDs,
+ * whichever is the most compact (similar to "roaring bitmaps").
+ *
+ * Several threads can read from the set at the same time, but not while
+ * another thread changes it.
+ */
+class CompressedIdSet {
+
+public:
+
+    using id_type = osmium::unsigned_object_id_type;
+
+private:
+
+    enum class container_type : uint8_t {
+        array  = 0,
+        bitmap = 1,
+        run    = 2
+    };
+
+    struct container {
+        // For arrays: sorted IDs (the lower 16 bits). For runs: first and
+        // last ID of each run, sorted.
+        std::vector<uint16_t> values;
+
+        // For bitmaps: one bit per ID.
+        std::vector<uint64_t> bits;
+
+        container_type type = container_type::array;
+    };
+
+    static constexpr const unsigned int chunk_bits = 16;
+    static constexpr const id_type chunk_mask = (1U << chunk_bits) - 1;
+    static constexpr const uint32_t chunk_size = 1U << chunk_bits;
+    static constexpr const std::size_t bitmap_words = chunk_size / 64;
+
+    // An array or run container with more entries than this is bigger than
+    // a bitmap.
+    static constexpr const std::size_t max_array_values = bitmap_words * 4;
+
+    // Containers by chunk number (the ID without the lower 16 bits).
+    std::map<id_type, container> m_containers;
+
+    std::size_t m_size = 0;
+
+    // The container IDs were added to last. IDs are usually added in
+    // order, so this saves the search in the map in most cases. It is only
+    // updated by set(), so that concurrent calls of the const functions
+    // are safe as long as nobody changes the set.
+    id_type m_last_key = 0;
+    container* m_last_container = nullptr;
+
+    const container* find_container(id_type key) const noexcept;
+
+    container& get_container(id_type key);
+
+    static std::size_t first_run(const container& c, uint32_t value) noexcept;
+
+    static bool container_get(const container& c, uint16_t value) noexcept;
+
+    static bool container_set(container* c, uint16_t value);
+
+    static bool container_next(const container& c, uint32_t value, uint16_t* result) noexcept;
+
+    static void array_to_bitmap_or_runs(container* c);
+
+    static void runs_to_bitmap(container* c);
+
+    /**
+     * Call func with each ID in container c (with chunk number key)
+     * starting from value. If func adds IDs to the set, the container
+     * might have changed, so stop and return the next value to look at.
+     * Otherwise return chunk_size.
+     */
+    template <typename TFunc>
+    uint32_t container_for_each(const container& c, id_type key, uint32_t value, TFunc& func) const {
+        const id_type base = key << chunk_bits;
+        const std::size_t size = m_size;
+
+        switch (c.type) {
+            case container_type::array:
+                for (auto it = std::lower_bound(c.values.begin(), c.values.end(), value); it != c.values.end(); ++it) {
+                    const uint32_t v = *it;
+                    func(base | v);
+                    if (m_size != size) {
+                        return v + 1;
+                    }
+                }
+                return chunk_size;
+            case container_type::bitmap:
+                for (uint32_t word = value / 64; word < bitmap_words; ++word) {
+                    uint64_t bits = c.bits[word];
+                    uint32_t v = word * 64;
+                    if (word == value / 64) {
+                        bits >>= value % 64;
+                        v = value;
+                    }
+                    for (; bits != 0; bits >>= 1U, ++v) {
+                        if (bits & 1U) {
+                            func(base | v);
+                            if (m_size != size) {
+                                return v + 1;
+                            }
+                        }
+                    }
+                }
+                return chunk_size;
+            case container_type::run:
+                break;
+        }
+
+        for (std::size_t n = first_run(c, value); n < c.values.size() / 2; ++n) {
+            const uint32_t last = c.values[n * 2 + 1];
+            for (uint32_t v = std::max(static_cast<uint32_t>(c.values[n * 2]), value); v <= last; ++v) {
+                func(base | v);
+                if (m_size != size) {
+                    return v + 1;
+                }
+            }
+        }
+        return chunk_size;
+    }
+
+public:
+
+    CompressedIdSet() = default;
+
+    // The copy would point to the wrong m_last_container.
+    CompressedIdSet(const CompressedIdSet&) = delete;
+    CompressedIdSet& operator=(const CompressedIdSet&) = delete;
+
+    CompressedIdSet(CompressedIdSet&& other) noexcept;
+    CompressedIdSet& operator=(CompressedIdSet&& other) noexcept;
+
+    ~CompressedIdSet() = default;
+
+    /// Is the ID in the set?
+    bool get(id_type id) const noexcept;
+
+    /// Add the ID to the set.
+    void set(id_type id);
+
+    /**
+     * Find the smallest ID in the set that is equal to or larger than id.
+     * Returns false if there is none.
+     */
+    bool next(id_type* id) const noexcept;
+
+    bool empty() const noexcept {
+        return m_size == 0;
+    }
+
+    /// The number of IDs in the set.
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    std::size_t used_memory() const noexcept;
+
+    /**
+     * Call func with each ID in the set in ascending order. The function
+     * can add IDs to the set. IDs added that are larger than the current
+     * ID will be visited, too.
+     */
+    template <typename TFunc>
+    void for_each(TFunc&& func) const {
+        // Map iterators stay valid when containers are added, so new
+        // containers after the current one are visited, too.
+        for (auto it = m_containers.begin(); it != m_containers.end(); ++it) {
+            uint32_t value = 0;
+            while (value < chunk_size) {
+                value = container_for_each(it->second, it->first, value, func);
+            }
+        }
+    }
+
+}; // class CompressedIdSet
+
+enum class id_set_type : uint8_t {
+    dense      = 0,
+    compressed = 1
+};
+
+/**
+ * ID set used by the extract strategies. It is either an IdSetDense from
+ * libosmium, which is fastest, but needs a lot of memory if the IDs are
+ * spread over the whole ID space, or a CompressedIdSet. The type must be
+ * set before any IDs are added.
+ */
+class ExtractIdSet {
+
+    osmium::index::IdSetDense<osmium::unsigned_object_id_type> m_dense;
+    CompressedIdSet m_compressed;
+    id_set_type m_type = id_set_type::dense;
+
+public:
+
+    id_set_type type() const noexcept {
+        return m_type;
+    }
+
+    void set_type(id_set_type type) noexcept {
+        m_type = type;
+    }
+
+    bool get(osmium::unsigned_object_id_type id) const noexcept {
+        if (m_type == id_set_type::dense) {
+            return m_dense.get(id);
+        }
+        return m_compressed.get(id);
+    }
+
+    void set(osmium::unsigned_object_id_type id) {
+        if (m_type == id_set_type::dense) {
+            m_dense.set(id);
+        } else {
+            m_compressed.set(id);
+        }
+    }
+
+    std::size_t size() const noexcept {
+        if (m_type == id_set_type::dense) {
+            return m_dense.size();
+        }
+        return m_compressed.size();
+    }
+
+    /// Call func with each ID in the set in ascending order.
+    template <typename TFunc>
+    void for_each(TFunc&& func) const {
+        if (m_type == id_set_type::dense) {
+            for (const osmium::unsigned_object_id_type id : m_dense) {
+                func(id);
+            }
+        } else {
+            m_compressed.for_each(std::forward<TFunc>(func));
+        }
+    }
+
+}; // class ExtractIdSet
+
+#endif // EXTRACT_ID_SET_HPP
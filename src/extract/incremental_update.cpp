@@ -0,0 +1,163 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "incremental_update.hpp"
+
+#include "../compacting_loader.hpp"
+
+#include <osmium/io/reader.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/object_pointer_collection.hpp>
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/object_comparisons.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/way.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Decide which objects from the (sorted) change go into the extract and
+// update the state accordingly.
+std::vector<bool> select_changes(osmium::ObjectPointerCollection& objects, const Extract& extract, ExtractState* state, bool complete_ways) {
+    std::vector<bool> selected(objects.size());
+
+    // Nodes needed to complete the ways added to the extract.
+    CompressedIdSet way_nodes;
+
+    std::size_t n = 0;
+    for (const auto& object : objects) {
+        const auto id = object.positive_id();
+        switch (object.type()) {
+            case osmium::item_type::node: {
+                const auto& node = static_cast<const osmium::Node&>(object);
+                if (node.visible() && extract.contains(node.location())) {
+                    state->inside_nodes().set(id);
+                    selected[n] = true;
+                } else {
+                    selected[n] = state->nodes().get(id);
+                }
+                break;
+            }
+            case osmium::item_type::way: {
+                const auto& way = static_cast<const osmium::Way&>(object);
+                bool select = state->ways().get(id);
+                if (!select && way.visible()) {
+                    for (const auto& nr : way.nodes()) {
+                        if (state->inside_nodes().get(nr.positive_ref())) {
+                            select = true;
+                            break;
+                        }
+                    }
+                }
+                if (select && complete_ways && way.visible()) {
+                    for (const auto& nr : way.nodes()) {
+                        way_nodes.set(nr.positive_ref());
+                    }
+                }
+                selected[n] = select;
+                if (select) {
+                    state->ways().set(id);
+                }
+                break;
+            }
+            case osmium::item_type::relation: {
+                const auto& relation = static_cast<const osmium::Relation&>(object);
+                bool select = state->relations().get(id);
+                if (!select && relation.visible()) {
+                    for (const auto& member : relation.members()) {
+                        const auto ref = member.positive_ref();
+                        if ((member.type() == osmium::item_type::node && state->inside_nodes().get(ref)) ||
+                            (member.type() == osmium::item_type::way && state->ways().get(ref)) ||
+                            (member.type() == osmium::item_type::relation && state->relations().get(ref))) {
+                            select = true;
+                            break;
+                        }
+                    }
+                }
+                selected[n] = select;
+                if (select) {
+                    state->relations().set(id);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        ++n;
+    }
+
+    // Add nodes from the change needed to complete the selected ways.
+    if (!way_nodes.empty()) {
+        n = 0;
+        for (const auto& object : objects) {
+            if (object.type() != osmium::item_type::node) {
+                break;
+            }
+            if (object.visible() && way_nodes.get(object.positive_id())) {
+                selected[n] = true;
+            }
+            ++n;
+        }
+    }
+
+    return selected;
+}
+
+} // anonymous namespace
+
+void IncrementalUpdate::run(osmium::VerboseOutput& vout, const osmium::io::File& change_file) {
+    vout << "Reading change file...\n";
+    CompactingLoader changes;
+    osmium::ObjectPointerCollection objects;
+    osmium::io::Reader reader{change_file, osmium::osm_entity_bits::object};
+    while (osmium::memory::Buffer buffer = reader.read()) {
+        changes.add(buffer, [&](osmium::OSMObject& object) {
+            objects.osm_object(object);
+        });
+    }
+    reader.close();
+    changes.report(vout);
+
+    vout << "Sorting change data...\n";
+    objects.sort(osmium::object_order_type_id_version());
+
+    vout << "Writing changes for " << m_extracts.size() << " extracts...\n";
+    for (const auto& extract : m_extracts) {
+        assert(extract->state());
+        const auto selected = select_changes(objects, *extract, extract->state(), m_complete_ways);
+        std::size_t n = 0;
+        std::size_t count = 0;
+        for (const auto& object : objects) {
+            if (selected[n++]) {
+                extract->write(object);
+                ++count;
+            }
+        }
+        vout << "  " << count << " changes for extract '" << extract->output() << "'.\n";
+    }
+}
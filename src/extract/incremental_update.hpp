@@ -0,0 +1,70 @@
+#ifndef EXTRACT_INCREMENTAL_UPDATE_HPP
+#define EXTRACT_INCREMENTAL_UPDATE_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "extract.hpp"
+
+#include <osmium/io/file.hpp>
+#include <osmium/util/verbose_output.hpp>
+
+#include <memory>
+#include <vector>
+
+/**
+ * Creates a change file for each extract from a change file for the whole
+ * input and the states of the extracts from an earlier run. Applying the
+ * change file to the old extract gives the updated extract.
+ *
+ * The result is not always the same as creating the extract from scratch,
+ * because only the objects in the change file and the states are known:
+ *
+ * - Objects are only removed from an extract if they are deleted, not if
+ *   they are moved out of the extract geometry.
+ * - If a way is added to an extract, only those of its nodes that are in
+ *   the extract or in the change file are added, too.
+ * - Ways and relations that didn't change aren't added to an extract even
+ *   if one of their nodes or members moved into the extract.
+ */
+class IncrementalUpdate {
+
+    const std::vector<std::unique_ptr<Extract>>& m_extracts;
+    bool m_complete_ways;
+
+public:
+
+    /**
+     * All extracts must have a state. If complete_ways is set, nodes
+     * in the change file needed to complete ways in an extract are added
+     * to that extract like the 'complete_ways' and 'smart' strategies do.
+     */
+    IncrementalUpdate(const std::vector<std::unique_ptr<Extract>>& extracts, bool complete_ways) :
+        m_extracts(extracts),
+        m_complete_ways(complete_ways) {
+    }
+
+    void run(osmium::VerboseOutput& vout, const osmium::io::File& change_file);
+
+}; // class IncrementalUpdate
+
+#endif // EXTRACT_INCREMENTAL_UPDATE_HPP
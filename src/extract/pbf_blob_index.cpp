@@ -0,0 +1,140 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "pbf_blob_index.hpp"
+
+#include <osmium/io/file_compression.hpp>
+#include <osmium/io/file_format.hpp>
+#include <osmium/thread/pool.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+std::unique_ptr<PbfBlobIndex> PbfBlobIndex::create(const osmium::io::File& file) {
+    if (file.filename().empty() ||
+        file.format() != osmium::io::file_format::pbf ||
+        file.compression() != osmium::io::file_compression::none) {
+        return nullptr;
+    }
+
+    return std::make_unique<PbfBlobIndex>(file.filename());
+}
+
+PbfBlobIndex::PbfBlobIndex(const std::string& filename) :
+    m_reader(filename) {
+    pbf_blob blob;
+    while (m_reader.next(&blob)) {
+        if (blob.type == "OSMData") {
+            m_blobs.push_back(blob);
+        }
+    }
+}
+
+bool PbfBlobIndex::contains_any(std::size_t n, osmium::osm_entity_bits::type types) {
+    const auto buffer = decode_pbf_data_blob(m_reader.read_data(m_blobs[n]), types, osmium::io::read_meta::no);
+    return buffer.committed() > 0;
+}
+
+// Returns the first blob in [begin, end) for which predicate is true, the
+// predicate must be false for all blobs before and true for all after it.
+template <typename TPredicate>
+std::size_t PbfBlobIndex::partition_point(std::size_t begin, std::size_t end, TPredicate&& predicate) {
+    while (begin < end) {
+        const std::size_t middle = begin + (end - begin) / 2;
+        if (predicate(middle)) {
+            end = middle;
+        } else {
+            begin = middle + 1;
+        }
+    }
+    return begin;
+}
+
+std::pair<std::size_t, std::size_t> PbfBlobIndex::range(osmium::osm_entity_bits::type types) {
+    const osmium::osm_entity_bits::type order[] = {
+        osmium::osm_entity_bits::node,
+        osmium::osm_entity_bits::way,
+        osmium::osm_entity_bits::relation
+    };
+
+    // The types given and all types after them or before them.
+    auto from_types = osmium::osm_entity_bits::nothing;
+    auto to_types = osmium::osm_entity_bits::nothing;
+    for (std::size_t i = 0; i < 3; ++i) {
+        if ((types & order[i]) || from_types) {
+            from_types |= order[i];
+        }
+        if ((types & order[2 - i]) || to_types) {
+            to_types |= order[2 - i];
+        }
+    }
+
+    // The first blob with any objects of the types or after them, and the
+    // first blob after that with only objects of types after them.
+    const std::size_t begin = partition_point(0, m_blobs.size(), [&](std::size_t n) {
+        return contains_any(n, from_types);
+    });
+    const std::size_t end = partition_point(begin, m_blobs.size(), [&](std::size_t n) {
+        return !contains_any(n, to_types);
+    });
+
+    return std::make_pair(begin, end);
+}
+
+PbfBlobSource::PbfBlobSource(PbfBlobIndex& index, osmium::osm_entity_bits::type types, osmium::io::read_meta read_meta) :
+    m_index(&index),
+    m_types(types),
+    m_read_meta(read_meta) {
+    const auto range = index.range(types);
+    m_next = range.first;
+    m_end = range.second;
+}
+
+osmium::memory::Buffer PbfBlobSource::read() {
+    auto& pool = osmium::thread::Pool::default_instance();
+
+    // Keep enough blobs in flight to keep all threads busy.
+    const auto max_in_flight = static_cast<std::size_t>(pool.num_threads()) * 2;
+    while (m_next < m_end && m_futures.size() < max_in_flight) {
+        const auto& blob = (*m_index)[m_next++];
+        auto data = m_index->reader().read_data(blob);
+        const auto types = m_types;
+        const auto read_meta = m_read_meta;
+        m_futures.push_back(pool.submit([data = std::move(data), types, read_meta]() mutable {
+            return decode_pbf_data_blob(std::move(data), types, read_meta);
+        }));
+        m_offsets.push_back(blob.end_offset());
+    }
+
+    if (m_futures.empty()) {
+        return osmium::memory::Buffer{};
+    }
+
+    auto buffer = m_futures.front().get();
+    m_futures.pop_front();
+    m_offset = m_offsets.front();
+    m_offsets.pop_front();
+
+    return buffer;
+}
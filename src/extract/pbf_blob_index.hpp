@@ -0,0 +1,125 @@
+#ifndef EXTRACT_PBF_BLOB_INDEX_HPP
+#define EXTRACT_PBF_BLOB_INDEX_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "../pbf_blob_reader.hpp"
+
+#include <osmium/io/file.hpp>
+#include <osmium/io/reader.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/entity_bits.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Index of the data blobs in a PBF file. If the file is sorted (which the
+ * first pass of the extract strategies checks), all nodes come before all
+ * ways which come before all relations. So the blobs containing objects
+ * of some types can be found with a binary search which only has to
+ * decode a few blobs, and the other blobs can be skipped in later passes.
+ */
+class PbfBlobIndex {
+
+    PbfBlobReader m_reader;
+    std::vector<pbf_blob> m_blobs;
+
+    bool contains_any(std::size_t n, osmium::osm_entity_bits::type types);
+
+    template <typename TPredicate>
+    std::size_t partition_point(std::size_t begin, std::size_t end, TPredicate&& predicate);
+
+public:
+
+    /**
+     * Create index for the file. Returns nullptr if the file is not a PBF
+     * file on disk.
+     */
+    static std::unique_ptr<PbfBlobIndex> create(const osmium::io::File& file);
+
+    explicit PbfBlobIndex(const std::string& filename);
+
+    PbfBlobReader& reader() noexcept {
+        return m_reader;
+    }
+
+    /// The number of data blobs in the file.
+    std::size_t size() const noexcept {
+        return m_blobs.size();
+    }
+
+    const pbf_blob& operator[](std::size_t n) const noexcept {
+        return m_blobs[n];
+    }
+
+    /**
+     * The range of blobs which contain the objects of the given types.
+     * The types must be consecutive in the order node, way, relation.
+     */
+    std::pair<std::size_t, std::size_t> range(osmium::osm_entity_bits::type types);
+
+}; // class PbfBlobIndex
+
+/**
+ * Reads and decodes a range of blobs from a PBF file. The blobs are
+ * decoded in the thread pool, the buffers are returned in order. This
+ * can be used instead of an osmium::io::Reader in Pass::run_source().
+ */
+class PbfBlobSource {
+
+    PbfBlobIndex* m_index;
+    std::size_t m_next;
+    std::size_t m_end;
+    osmium::osm_entity_bits::type m_types;
+    osmium::io::read_meta m_read_meta;
+    std::deque<std::future<osmium::memory::Buffer>> m_futures;
+    std::deque<std::uint64_t> m_offsets;
+    std::uint64_t m_offset = 0;
+
+public:
+
+    PbfBlobSource(PbfBlobIndex& index, osmium::osm_entity_bits::type types, osmium::io::read_meta read_meta = osmium::io::read_meta::yes);
+
+    /// The number of blobs that will be read.
+    std::size_t size() const noexcept {
+        return m_end - m_next + m_futures.size();
+    }
+
+    /// Return the next buffer or an invalid buffer at the end.
+    osmium::memory::Buffer read();
+
+    /// Offset in the file after the blob returned last.
+    std::uint64_t offset() const noexcept {
+        return m_offset;
+    }
+
+}; // class PbfBlobSource
+
+#endif // EXTRACT_PBF_BLOB_INDEX_HPP
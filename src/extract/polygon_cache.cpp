@@ -0,0 +1,291 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "polygon_cache.hpp"
+
+#include "../exception.hpp"
+#include "../temp_file.hpp"
+
+#include <osmium/io/detail/read_write.hpp>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr const char cache_magic[8] = {'O', 'S', 'M', 'P', 'C', 'A', 'C', 'H'};
+constexpr const uint32_t cache_version = 3;
+
+// Written to the file to detect caches from machines with another byte
+// order.
+constexpr const uint32_t byte_order_mark = 0x01020304;
+
+class cache_writer {
+
+    std::string m_data;
+
+public:
+
+    void write_bytes(const void* data, std::size_t size) {
+        m_data.append(static_cast<const char*>(data), size);
+    }
+
+    template <typename T>
+    void write(T value) {
+        write_bytes(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void write_vector(const std::vector<T>& values) {
+        write<uint64_t>(values.size());
+        write_bytes(values.data(), values.size() * sizeof(T));
+    }
+
+    const std::string& data() const noexcept {
+        return m_data;
+    }
+
+}; // class cache_writer
+
+// Reads from the contents of a cache file. All functions return false
+// if there is not enough data left.
+class cache_reader {
+
+    const std::string& m_data;
+    std::size_t m_pos = 0;
+
+public:
+
+    explicit cache_reader(const std::string& data) noexcept :
+        m_data(data) {
+    }
+
+    bool read_bytes(void* data, std::size_t size) noexcept {
+        if (size > m_data.size() - m_pos) {
+            return false;
+        }
+        std::memcpy(data, m_data.data() + m_pos, size);
+        m_pos += size;
+        return true;
+    }
+
+    template <typename T>
+    bool read(T* value) noexcept {
+        return read_bytes(value, sizeof(T));
+    }
+
+    template <typename T>
+    bool read_vector(std::vector<T>* values) {
+        uint64_t size = 0;
+        if (!read(&size) || size > (m_data.size() - m_pos) / sizeof(T)) {
+            return false;
+        }
+        values->resize(size);
+        return read_bytes(values->data(), size * sizeof(T));
+    }
+
+    bool at_end() const noexcept {
+        return m_pos == m_data.size();
+    }
+
+}; // class cache_reader
+
+} // anonymous namespace
+
+void PolygonCacheKey::add(const std::string& data) noexcept {
+    for (const char c : data) {
+        m_hash ^= static_cast<unsigned char>(c);
+        m_hash *= 0x100000001b3ULL;
+    }
+
+    // Also add the size so that the boundaries between the parts can't
+    // be moved without changing the hash.
+    for (auto size = static_cast<uint64_t>(data.size()); size; size >>= 8U) {
+        m_hash ^= size & 0xffU;
+        m_hash *= 0x100000001b3ULL;
+    }
+}
+
+bool PolygonCache::load(osmium::memory::Buffer* buffer) {
+    assert(buffer && buffer->committed() == 0);
+
+    std::ifstream file{m_filename, std::ios::binary};
+    if (!file) {
+        return false;
+    }
+    const std::string content{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+
+    cache_reader reader{content};
+
+    char magic[sizeof(cache_magic)];
+    uint32_t version = 0;
+    uint32_t mark = 0;
+    uint32_t word_size = 0;
+    uint64_t key = 0;
+    if (!reader.read_bytes(magic, sizeof(magic)) ||
+        std::memcmp(magic, cache_magic, sizeof(magic)) != 0 ||
+        !reader.read(&version) || version != cache_version ||
+        !reader.read(&mark) || mark != byte_order_mark ||
+        !reader.read(&word_size) || word_size != sizeof(std::size_t) ||
+        !reader.read(&key) || key != m_key) {
+        return false;
+    }
+
+    std::vector<unsigned char> buffer_data;
+    uint64_t num_entries = 0;
+    if (!reader.read_vector(&buffer_data) || !reader.read(&num_entries)) {
+        return false;
+    }
+
+    std::vector<entry> entries;
+    for (uint64_t n = 0; n < num_entries; ++n) {
+        entry e;
+        uint64_t offset = 0;
+        uint64_t num_parts = 0;
+        if (!reader.read(&offset) || offset >= buffer_data.size() ||
+            !reader.read(&num_parts)) {
+            return false;
+        }
+        e.offset = offset;
+        for (uint64_t p = 0; p < num_parts; ++p) {
+            ExtractPolygon::prepared_data part;
+            int32_t x_min = 0;
+            int32_t y_min = 0;
+            int32_t x_max = 0;
+            int32_t y_max = 0;
+            uint64_t raster_size = 0;
+            if (!reader.read(&x_min) ||
+                !reader.read(&y_min) ||
+                !reader.read(&x_max) ||
+                !reader.read(&y_max) ||
+                !reader.read_vector(&part.band_nodes) ||
+                !reader.read_vector(&part.band_children) ||
+                !reader.read_vector(&part.band_offsets) ||
+                !reader.read_vector(&part.x1) ||
+                !reader.read_vector(&part.y1) ||
+                !reader.read_vector(&part.x2) ||
+                !reader.read_vector(&part.y2) ||
+                !reader.read_vector(&part.raster) ||
+                !reader.read(&raster_size) ||
+                !reader.read(&part.cell_width) ||
+                !reader.read(&part.cell_height)) {
+                return false;
+            }
+            part.envelope = osmium::Box{osmium::Location{x_min, y_min}, osmium::Location{x_max, y_max}};
+            part.raster_size = raster_size;
+            e.parts.push_back(std::move(part));
+        }
+        entries.push_back(std::move(e));
+    }
+
+    if (!reader.at_end()) {
+        return false;
+    }
+
+    if (!buffer_data.empty()) {
+        std::memcpy(buffer->reserve_space(buffer_data.size()), buffer_data.data(), buffer_data.size());
+        buffer->commit();
+    }
+
+    m_entries = std::move(entries);
+    m_next = 0;
+    m_loaded = true;
+
+    return true;
+}
+
+PolygonCache::entry& PolygonCache::next() {
+    assert(m_loaded);
+    if (m_next == m_entries.size()) {
+        throw config_error{"Polygon cache file '" + m_filename + "' does not match config."};
+    }
+    return m_entries[m_next++];
+}
+
+void PolygonCache::add(std::size_t offset, std::vector<ExtractPolygon::prepared_data>&& parts) {
+    entry e;
+    e.offset = offset;
+    e.parts = std::move(parts);
+    m_entries.push_back(std::move(e));
+}
+
+bool PolygonCache::save(const osmium::memory::Buffer& buffer) const {
+    cache_writer writer;
+
+    writer.write_bytes(cache_magic, sizeof(cache_magic));
+    writer.write(cache_version);
+    writer.write(byte_order_mark);
+    writer.write(static_cast<uint32_t>(sizeof(std::size_t)));
+    writer.write(m_key);
+
+    writer.write<uint64_t>(buffer.committed());
+    writer.write_bytes(buffer.data(), buffer.committed());
+
+    writer.write<uint64_t>(m_entries.size());
+    for (const auto& e : m_entries) {
+        writer.write<uint64_t>(e.offset);
+        writer.write<uint64_t>(e.parts.size());
+        for (const auto& part : e.parts) {
+            writer.write(part.envelope.bottom_left().x());
+            writer.write(part.envelope.bottom_left().y());
+            writer.write(part.envelope.top_right().x());
+            writer.write(part.envelope.top_right().y());
+            writer.write_vector(part.band_nodes);
+            writer.write_vector(part.band_children);
+            writer.write_vector(part.band_offsets);
+            writer.write_vector(part.x1);
+            writer.write_vector(part.y1);
+            writer.write_vector(part.x2);
+            writer.write_vector(part.y2);
+            writer.write_vector(part.raster);
+            writer.write<uint64_t>(part.raster_size);
+            writer.write(part.cell_width);
+            writer.write(part.cell_height);
+        }
+    }
+
+    // Write to a temporary file in the same directory first and rename
+    // it, so that other osmium processes using the same cache never see
+    // a partially written cache. The temporary file is removed if
+    // anything goes wrong.
+    const auto pos = m_filename.find_last_of("/\\");
+    const std::string directory = pos == std::string::npos ? std::string{"."} : m_filename.substr(0, pos + 1);
+    try {
+        TempFile file{directory, ".tmp"};
+        osmium::io::detail::reliable_write(file.fd(), writer.data().data(), writer.data().size());
+        file.rename(m_filename);
+    } catch (const std::system_error&) {
+        return false;
+    }
+
+    return true;
+}
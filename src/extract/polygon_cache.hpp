@@ -0,0 +1,125 @@
+#ifndef EXTRACT_POLYGON_CACHE_HPP
+#define EXTRACT_POLYGON_CACHE_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "extract_polygon.hpp"
+
+#include <osmium/memory/buffer.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Calculates the key for a polygon cache file from the contents of the
+ * config file and all polygon files it references (64 bit FNV-1a hash).
+ */
+class PolygonCacheKey {
+
+    uint64_t m_hash = 0xcbf29ce484222325ULL;
+
+public:
+
+    void add(const std::string& data) noexcept;
+
+    uint64_t value() const noexcept {
+        return m_hash;
+    }
+
+}; // class PolygonCacheKey
+
+/**
+ * A file containing the polygons of all extracts in a config file
+ * together with the data structures prepared from them for the
+ * point-in-polygon checks. If a config has thousands of (multi)polygons,
+ * reading and preparing them takes much longer than reading this file.
+ *
+ * The file is only valid for the config it was created from, this is
+ * checked with the key. It is not portable between machines with
+ * different byte order or word size.
+ */
+class PolygonCache {
+
+public:
+
+    struct entry {
+        std::size_t offset = 0;
+        std::vector<ExtractPolygon::prepared_data> parts;
+    };
+
+private:
+
+    std::string m_filename;
+    uint64_t m_key;
+    std::vector<entry> m_entries;
+    std::size_t m_next = 0;
+    bool m_loaded = false;
+
+public:
+
+    PolygonCache(std::string filename, uint64_t key) :
+        m_filename(std::move(filename)),
+        m_key(key) {
+    }
+
+    const std::string& filename() const noexcept {
+        return m_filename;
+    }
+
+    /**
+     * Try to read the cache file. If it exists and was written for the
+     * same key, the polygons from it are added to the buffer, which must
+     * be empty, and true is returned. Otherwise nothing is changed and
+     * false is returned.
+     */
+    bool load(osmium::memory::Buffer* buffer);
+
+    /// Was the cache loaded successfully?
+    bool loaded() const noexcept {
+        return m_loaded;
+    }
+
+    /**
+     * Get the next polygon from a loaded cache. Polygons are returned
+     * in the order in which they were added when the cache was written.
+     *
+     * @throws config_error if there are no more polygons in the cache.
+     */
+    entry& next();
+
+    /// Remember a polygon for writing to the cache.
+    void add(std::size_t offset, std::vector<ExtractPolygon::prepared_data>&& parts);
+
+    /**
+     * Write the cache file with the contents of the buffer and all
+     * polygons added. The cache is only an optimization, so if the file
+     * can not be written, nothing is written and false is returned.
+     */
+    bool save(const osmium::memory::Buffer& buffer) const;
+
+}; // class PolygonCache
+
+#endif // EXTRACT_POLYGON_CACHE_HPP
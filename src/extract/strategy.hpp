@@ -23,23 +23,37 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 */
 
+#include "envelope_index.hpp"
 #include "extract.hpp"
+#include "id_set.hpp"
+#include "pbf_blob_index.hpp"
+
+#include "../exception.hpp"
 
 #include <osmium/io/file.hpp>
 #include <osmium/io/reader.hpp>
 #include <osmium/io/writer.hpp>
 #include <osmium/memory/buffer.hpp>
 #include <osmium/memory/item.hpp>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
 #include <osmium/osm/node.hpp>
 #include <osmium/osm/object.hpp>
 #include <osmium/osm/relation.hpp>
 #include <osmium/osm/types.hpp>
 #include <osmium/osm/way.hpp>
+#include <osmium/thread/pool.hpp>
 #include <osmium/util/progress_bar.hpp>
 #include <osmium/util/verbose_output.hpp>
 
+#include <atomic>
 #include <cassert>
+#include <cstddef>
+#include <exception>
+#include <future>
 #include <memory>
+#include <string>
+#include <vector>
 
 template <typename T>
 class ExtractData : public T {
@@ -53,10 +67,26 @@ public:
         m_extract_ptr(&extract) {
     }
 
+    const osmium::Box& envelope() const noexcept {
+        return m_extract_ptr->envelope();
+    }
+
+    std::size_t parent() const noexcept {
+        return m_extract_ptr->parent();
+    }
+
     bool contains(const osmium::Location& location) const noexcept {
         return m_extract_ptr->contains(location);
     }
 
+    void contains_batch(const std::vector<osmium::Location>& locations, std::vector<bool>* results) const {
+        m_extract_ptr->contains_batch(locations, results);
+    }
+
+    void add_inside_node(const osmium::Node& node) {
+        m_extract_ptr->add_inside_node(node);
+    }
+
     void write(const osmium::memory::Item& item) {
         m_extract_ptr->write(item);
     }
@@ -70,6 +100,22 @@ public:
 
 class ExtractStrategy {
 
+    unsigned int m_num_threads = 1;
+    const EnvelopeIndex* m_envelope_index = nullptr;
+    std::string m_id_sets{"auto"};
+    std::string m_tmp_dir;
+
+protected:
+
+    // Set the type of the ID sets of all extracts according to the
+    // "id-sets" option. Call this at the end of the constructor.
+    template <typename TExtractData>
+    void init_id_sets(std::vector<TExtractData>& extracts) const {
+        for (auto& e : extracts) {
+            e.set_id_set_type(id_set_type_for(e.envelope()));
+        }
+    }
+
 public:
 
     ExtractStrategy() = default;
@@ -78,9 +124,73 @@ public:
 
     virtual const char* name() const noexcept = 0;
 
+    /// Number of threads used for checking objects against the extracts.
+    unsigned int num_threads() const noexcept {
+        return m_num_threads;
+    }
+
+    void set_num_threads(unsigned int num_threads) noexcept {
+        m_num_threads = num_threads;
+    }
+
+    /// Index over the envelopes of the extracts (can be nullptr).
+    const EnvelopeIndex* envelope_index() const noexcept {
+        return m_envelope_index;
+    }
+
+    void set_envelope_index(const EnvelopeIndex* envelope_index) noexcept {
+        m_envelope_index = envelope_index;
+    }
+
+    /// Directory for temporary files (if the strategy needs any).
+    const std::string& tmp_dir() const noexcept {
+        return m_tmp_dir;
+    }
+
+    void set_tmp_dir(const std::string& tmp_dir) {
+        m_tmp_dir = tmp_dir;
+    }
+
+    /// Set the type of ID sets ("auto", "dense", or "compressed").
+    void set_id_sets(const std::string& id_sets) {
+        if (id_sets != "auto" && id_sets != "dense" && id_sets != "compressed") {
+            throw argument_error{"Unknown value for 'id-sets' strategy option: '" + id_sets + "' (allowed are 'auto', 'dense', and 'compressed')."};
+        }
+        m_id_sets = id_sets;
+    }
+
+    const std::string& id_sets() const noexcept {
+        return m_id_sets;
+    }
+
+    /**
+     * The type of ID sets used for an extract with the specified envelope.
+     * With "auto" small extracts get compressed ID sets. The IDs of their
+     * objects are spread thinly over the whole ID space, so dense ID sets
+     * would need lots of memory for very few IDs.
+     */
+    id_set_type id_set_type_for(const osmium::Box& envelope) const noexcept {
+        if (m_id_sets == "dense") {
+            return id_set_type::dense;
+        }
+        if (m_id_sets == "compressed") {
+            return id_set_type::compressed;
+        }
+
+        constexpr const double max_compressed_area = 100.0; // square degrees
+        const double width = envelope.top_right().lon() - envelope.bottom_left().lon();
+        const double height = envelope.top_right().lat() - envelope.bottom_left().lat();
+        return width * height < max_compressed_area ? id_set_type::compressed : id_set_type::dense;
+    }
+
     virtual void show_arguments(osmium::VerboseOutput& /*vout*/) {
     }
 
+    /// Does this strategy read the input file more than once?
+    virtual bool needs_multiple_passes() const noexcept {
+        return true;
+    }
+
     virtual void run(osmium::VerboseOutput& vout, bool display_progress, const osmium::io::File& input_file) = 0;
 
 }; // class ExtractStrategy
@@ -89,42 +199,367 @@ public:
 template <typename TStrategy, typename TChild>
 class Pass {
 
+    // A run of consecutive nodes from a buffer and their locations.
+    struct node_batch {
+        std::vector<const osmium::Node*> nodes;
+        std::vector<osmium::Location> locations;
+
+        void add(const osmium::Node& node) {
+            nodes.push_back(&node);
+            locations.push_back(node.location());
+        }
+
+        bool empty() const noexcept {
+            return nodes.empty();
+        }
+
+        void clear() noexcept {
+            nodes.clear();
+            locations.clear();
+        }
+    };
+
+    // Scratch space for check_nodes(), kept around to avoid allocations.
+    // With several threads each one has its own.
+    struct node_scratch {
+        // The nodes collected by process_buffer_for_extracts().
+        node_batch batch;
+
+        // For each extract the nodes of the batch that have to be checked.
+        std::vector<std::vector<std::size_t>> candidates;
+
+        // For each extract that is the parent of other extracts the nodes
+        // of the batch that are inside.
+        std::vector<std::vector<bool>> inside;
+
+        std::vector<osmium::Location> locations;
+        std::vector<bool> results;
+
+        explicit node_scratch(std::size_t num_extracts) :
+            candidates(num_extracts),
+            inside(num_extracts) {
+        }
+    };
+
     TStrategy* m_strategy;
 
-    void run_impl(osmium::ProgressBar& progress_bar, osmium::io::Reader& reader) {
-        while (osmium::memory::Buffer buffer = reader.read()) {
-            progress_bar.update(reader.offset());
-            for (const auto& object : buffer) {
-                switch (object.type()) {
-                    case osmium::item_type::node:
-                        self().node(static_cast<const osmium::Node&>(object));
+    node_batch m_batch;
+    std::vector<std::size_t> m_all_extracts;
+    std::unique_ptr<node_scratch> m_scratch;
+
+    // Is the extract the parent of any other extract?
+    std::vector<bool> m_is_parent;
+
+    // Check the nodes in the batch against the extracts with the given
+    // indexes one extract after the other, so the data of each extract
+    // stays in the cache, and call enode_inside() for the nodes inside.
+    // Parents must come before their children in extract_indexes, a child
+    // only gets the nodes inside its parent. If use_candidates is set,
+    // extracts without parent only get the nodes already in their
+    // candidates list, otherwise all nodes.
+    void check_nodes(const std::vector<std::size_t>& extract_indexes, const node_batch& batch, node_scratch* scratch, bool use_candidates) {
+        for (const auto e : extract_indexes) {
+            auto& data = extracts()[e];
+            auto& candidates = scratch->candidates[e];
+            auto& inside = scratch->inside[e];
+            const bool is_parent = m_is_parent[e];
+
+            const auto parent = data.parent();
+            if (parent != Extract::no_parent) {
+                assert(parent < e);
+                const auto& parent_inside = scratch->inside[parent];
+                for (std::size_t n = 0; n < batch.nodes.size(); ++n) {
+                    if (parent_inside[n]) {
+                        candidates.push_back(n);
+                    }
+                }
+            } else if (!use_candidates) {
+                for (std::size_t n = 0; n < batch.nodes.size(); ++n) {
+                    candidates.push_back(n);
+                }
+            }
+
+            if (is_parent) {
+                inside.assign(batch.nodes.size(), false);
+            }
+            if (candidates.empty()) {
+                continue;
+            }
+
+            scratch->locations.clear();
+            for (const auto n : candidates) {
+                scratch->locations.push_back(batch.locations[n]);
+            }
+            data.contains_batch(scratch->locations, &scratch->results);
+            for (std::size_t i = 0; i < candidates.size(); ++i) {
+                if (scratch->results[i]) {
+                    const auto& node = *batch.nodes[candidates[i]];
+                    if (is_parent) {
+                        inside[candidates[i]] = true;
+                    }
+                    data.add_inside_node(node);
+                    self().enode_inside(&data, node);
+                }
+            }
+            candidates.clear();
+        }
+    }
+
+    // Add the nodes in the batch to the candidates of the extracts for
+    // which wanted(e) is true if the node is inside their envelope.
+    template <typename TPredicate>
+    static void find_candidates(const EnvelopeIndex& index, const node_batch& batch, node_scratch* scratch, TPredicate&& wanted) {
+        for (std::size_t n = 0; n < batch.locations.size(); ++n) {
+            index.for_each(batch.locations[n], [&](std::size_t e) {
+                if (wanted(e)) {
+                    scratch->candidates[e].push_back(n);
+                }
+            });
+        }
+    }
+
+    // If there is an envelope index, the extracts only get the nodes
+    // inside their envelope.
+    void flush_nodes() {
+        if (m_batch.empty()) {
+            return;
+        }
+
+        const auto* index = m_strategy->envelope_index();
+        if (index) {
+            find_candidates(*index, m_batch, m_scratch.get(), [&](std::size_t e) {
+                return extracts()[e].parent() == Extract::no_parent;
+            });
+        }
+        check_nodes(m_all_extracts, m_batch, m_scratch.get(), index != nullptr);
+
+        m_batch.clear();
+    }
+
+    void process_buffer(const osmium::memory::Buffer& buffer) {
+        for (const auto& object : buffer) {
+            if (TChild::enode_inside_only && object.type() != osmium::item_type::node) {
+                flush_nodes();
+            }
+            switch (object.type()) {
+                case osmium::item_type::node:
+                    self().node(static_cast<const osmium::Node&>(object));
+                    if (TChild::enode_inside_only) {
+                        m_batch.add(static_cast<const osmium::Node&>(object));
+                    } else {
                         for (auto& e : extracts()) {
                             self().enode(&e, static_cast<const osmium::Node&>(object));
                         }
-                        break;
-                    case osmium::item_type::way:
-                        self().way(static_cast<const osmium::Way&>(object));
-                        for (auto& e : extracts()) {
-                            self().eway(&e, static_cast<const osmium::Way&>(object));
-                        }
-                        break;
-                    case osmium::item_type::relation:
-                        self().relation(static_cast<const osmium::Relation&>(object));
-                        for (auto& e : extracts()) {
-                            self().erelation(&e, static_cast<const osmium::Relation&>(object));
+                    }
+                    break;
+                case osmium::item_type::way:
+                    self().way(static_cast<const osmium::Way&>(object));
+                    for (auto& e : extracts()) {
+                        self().eway(&e, static_cast<const osmium::Way&>(object));
+                    }
+                    break;
+                case osmium::item_type::relation:
+                    self().relation(static_cast<const osmium::Relation&>(object));
+                    for (auto& e : extracts()) {
+                        self().erelation(&e, static_cast<const osmium::Relation&>(object));
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (TChild::enode_inside_only) {
+            flush_nodes();
+        }
+    }
+
+    // Like flush_nodes() for a single family of extracts. The first
+    // extract of the family is the one without parent.
+    void flush_nodes_for_extracts(const std::vector<std::size_t>& extract_indexes, node_scratch* scratch) {
+        auto& batch = scratch->batch;
+        if (batch.empty()) {
+            return;
+        }
+
+        const auto* index = m_strategy->envelope_index();
+        if (index) {
+            const auto root = extract_indexes.front();
+            find_candidates(*index, batch, scratch, [root](std::size_t e) {
+                return e == root;
+            });
+        }
+        check_nodes(extract_indexes, batch, scratch, index != nullptr);
+
+        batch.clear();
+    }
+
+    void process_buffer_for_extracts(const std::vector<std::size_t>& extract_indexes, const osmium::memory::Buffer& buffer, node_scratch* scratch) {
+        auto& batch = scratch->batch;
+        for (const auto& object : buffer) {
+            if (TChild::enode_inside_only && object.type() != osmium::item_type::node) {
+                flush_nodes_for_extracts(extract_indexes, scratch);
+            }
+            switch (object.type()) {
+                case osmium::item_type::node:
+                    if (TChild::enode_inside_only) {
+                        batch.add(static_cast<const osmium::Node&>(object));
+                    } else {
+                        for (const auto e : extract_indexes) {
+                            self().enode(&extracts()[e], static_cast<const osmium::Node&>(object));
                         }
-                        break;
-                    default:
-                        break;
+                    }
+                    break;
+                case osmium::item_type::way:
+                    for (const auto e : extract_indexes) {
+                        self().eway(&extracts()[e], static_cast<const osmium::Way&>(object));
+                    }
+                    break;
+                case osmium::item_type::relation:
+                    for (const auto e : extract_indexes) {
+                        self().erelation(&extracts()[e], static_cast<const osmium::Relation&>(object));
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (TChild::enode_inside_only) {
+            flush_nodes_for_extracts(extract_indexes, scratch);
+        }
+    }
+
+    // Call the node(), way(), and relation() hooks for all objects in the
+    // buffer first, then the per-extract hooks. The families of extracts
+    // (an extract without parent and all its descendants) are handed out
+    // one at a time to the threads from the pool and the current thread,
+    // so each extract sees all objects in order and is only ever used by
+    // a single thread. The buffer is only read. There must be one scratch
+    // for each thread of the pool and one for the current thread.
+    void process_buffer_parallel(osmium::thread::Pool& pool, const std::vector<std::vector<std::size_t>>& families, std::vector<node_scratch>* scratches, const osmium::memory::Buffer& buffer) {
+        for (const auto& object : buffer) {
+            switch (object.type()) {
+                case osmium::item_type::node:
+                    self().node(static_cast<const osmium::Node&>(object));
+                    break;
+                case osmium::item_type::way:
+                    self().way(static_cast<const osmium::Way&>(object));
+                    break;
+                case osmium::item_type::relation:
+                    self().relation(static_cast<const osmium::Relation&>(object));
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        const std::size_t size = families.size();
+        std::atomic<std::size_t> next_family{0};
+
+        const auto worker = [&](node_scratch* scratch) {
+            try {
+                for (std::size_t n = next_family++; n < size; n = next_family++) {
+                    process_buffer_for_extracts(families[n], buffer, scratch);
+                }
+            } catch (...) {
+                next_family = size; // stop other threads early
+                throw;
+            }
+        };
+
+        std::vector<std::future<void>> futures;
+        futures.reserve(pool.num_threads());
+        for (int i = 0; i < pool.num_threads(); ++i) {
+            node_scratch* scratch = &(*scratches)[static_cast<std::size_t>(i)];
+            futures.push_back(pool.submit([&worker, scratch]() {
+                worker(scratch);
+            }));
+        }
+
+        std::exception_ptr exception;
+        try {
+            worker(&scratches->back());
+        } catch (...) {
+            exception = std::current_exception();
+        }
+
+        // Always wait for all workers, they use data on this stack frame.
+        for (auto& future : futures) {
+            try {
+                future.get();
+            } catch (...) {
+                if (!exception) {
+                    exception = std::current_exception();
                 }
             }
         }
+
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+
+    // The reader can be an osmium::io::Reader or anything else with the
+    // read() and offset() functions, like a PbfBlobSource.
+    template <typename TReader>
+    void run_impl(osmium::ProgressBar& progress_bar, TReader& reader) {
+        m_is_parent.assign(extracts().size(), false);
+        for (const auto& e : extracts()) {
+            if (e.parent() != Extract::no_parent) {
+                m_is_parent[e.parent()] = true;
+            }
+        }
+
+        const unsigned int num_threads = m_strategy->num_threads();
+        if (num_threads <= 1 || extracts().size() <= 1) {
+            m_all_extracts.clear();
+            for (std::size_t e = 0; e < extracts().size(); ++e) {
+                m_all_extracts.push_back(e);
+            }
+            m_scratch = std::make_unique<node_scratch>(extracts().size());
+            while (osmium::memory::Buffer buffer = reader.read()) {
+                progress_bar.update(reader.offset());
+                process_buffer(buffer);
+            }
+            return;
+        }
+
+        // Group each extract with the extract at the top of its hierarchy.
+        std::vector<std::size_t> family_of_extract(extracts().size());
+        std::vector<std::vector<std::size_t>> families;
+        for (std::size_t e = 0; e < extracts().size(); ++e) {
+            const auto parent = extracts()[e].parent();
+            if (parent == Extract::no_parent) {
+                family_of_extract[e] = families.size();
+                families.emplace_back();
+            } else {
+                family_of_extract[e] = family_of_extract[parent];
+            }
+            families[family_of_extract[e]].push_back(e);
+        }
+
+        // The current thread does its share of the work, too.
+        osmium::thread::Pool pool{static_cast<int>(num_threads) - 1};
+        std::vector<node_scratch> scratches;
+        scratches.reserve(static_cast<std::size_t>(pool.num_threads()) + 1);
+        for (int i = 0; i <= pool.num_threads(); ++i) {
+            scratches.emplace_back(extracts().size());
+        }
+        while (osmium::memory::Buffer buffer = reader.read()) {
+            progress_bar.update(reader.offset());
+            process_buffer_parallel(pool, families, &scratches, buffer);
+        }
     }
 
 protected:
 
     using extract_data = typename TStrategy::extract_data;
 
+    // Set this to true in the child class if it only needs the nodes
+    // inside an extract. Instead of enode() it then has to implement
+    // enode_inside(), which is only called for those nodes. The nodes
+    // are collected and checked against the extracts in batches.
+    static constexpr const bool enode_inside_only = false;
+
     TStrategy& strategy() {
         return *m_strategy;
     }
@@ -149,6 +584,9 @@ protected:
     void enode(extract_data*, const osmium::Node&) {
     }
 
+    void enode_inside(extract_data*, const osmium::Node&) {
+    }
+
     void eway(extract_data*, const osmium::Way&) {
     }
 
@@ -169,6 +607,11 @@ public:
         reader.close();
     }
 
+    /// Run the pass on the blobs of a PBF file given by the source.
+    void run_source(osmium::ProgressBar& progress_bar, PbfBlobSource& source) {
+        run_impl(progress_bar, source);
+    }
+
 }; // class Pass
 
 
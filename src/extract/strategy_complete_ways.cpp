@@ -22,17 +22,58 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "strategy_complete_ways.hpp"
 
+#include "pbf_blob_index.hpp"
+
+#include "../cmd.hpp"
 #include "../util.hpp"
 
+#include <osmium/builder/osm_object_builder.hpp>
 #include <osmium/handler/check_order.hpp>
+#include <osmium/index/map/all.hpp>
+#include <osmium/memory/buffer.hpp>
 #include <osmium/util/file.hpp>
 
 #include <cstdlib>
+#include <limits>
 #include <memory>
 #include <vector>
 
 namespace strategy_complete_ways {
 
+    bool Data::add_way(const osmium::Way& way) {
+        for (const auto& nr : way.nodes()) {
+            if (node_ids.get(nr.positive_ref())) {
+                way_ids.set(way.positive_id());
+                for (const auto& nr : way.nodes()) {
+                    extra_node_ids.set(nr.ref());
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Data::add_relation(const osmium::Relation& relation) {
+        for (const auto& member : relation.members()) {
+            switch (member.type()) {
+                case osmium::item_type::node:
+                    if (node_ids.get(member.positive_ref())) {
+                        relation_ids.set(relation.positive_id());
+                        return;
+                    }
+                    break;
+                case osmium::item_type::way:
+                    if (way_ids.get(member.positive_ref())) {
+                        relation_ids.set(relation.positive_id());
+                        return;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
     void Data::add_relation_parents(osmium::unsigned_object_id_type id, const osmium::index::RelationsMapIndex& map) {
         map.for_each(id, [&](osmium::unsigned_object_id_type parent_id) {
             if (!relation_ids.get(parent_id)) {
@@ -49,7 +90,11 @@ namespace strategy_complete_ways {
         }
 
         for (const auto& option : options) {
-            if (option.first != "relations") {
+            if (option.first == "id-sets") {
+                set_id_sets(option.second);
+            } else if (option.first == "location-index") {
+                m_location_index_type = check_index_type(option.second);
+            } else if (option.first != "relations") {
                 warning(std::string{"Ignoring unknown option '"} + option.first + "' for 'complete_ways' strategy.\n");
             }
         }
@@ -57,12 +102,24 @@ namespace strategy_complete_ways {
         if (options.is_false("relations")) {
             m_read_types = osmium::osm_entity_bits::node | osmium::osm_entity_bits::way;
         }
+
+        init_id_sets(m_extracts);
     }
 
     const char* Strategy::name() const noexcept {
         return "complete_ways";
     }
 
+    void Strategy::show_arguments(osmium::VerboseOutput& vout) {
+        vout << "Additional strategy options:\n";
+        if (m_location_index_type.empty()) {
+            vout << "  - [location-index] none (two passes)\n";
+        } else {
+            vout << "  - [location-index] " << m_location_index_type << " (single pass)\n";
+        }
+        vout << '\n';
+    }
+
     class Pass1 : public Pass<Strategy, Pass1> {
 
         osmium::handler::CheckOrder m_check_order;
@@ -70,6 +127,8 @@ namespace strategy_complete_ways {
 
     public:
 
+        static constexpr const bool enode_inside_only = true;
+
         explicit Pass1(Strategy* strategy) :
             Pass(strategy) {
         }
@@ -78,10 +137,8 @@ namespace strategy_complete_ways {
             m_check_order.node(node);
         }
 
-        void enode(extract_data* e, const osmium::Node& node) {
-            if (e->contains(node.location())) {
-                e->node_ids.set(node.positive_id());
-            }
+        void enode_inside(extract_data* e, const osmium::Node& node) {
+            e->node_ids.set(node.positive_id());
         }
 
         void way(const osmium::Way& way) {
@@ -89,15 +146,7 @@ namespace strategy_complete_ways {
         }
 
         void eway(extract_data* e, const osmium::Way& way) {
-            for (const auto& nr : way.nodes()) {
-                if (e->node_ids.get(nr.positive_ref())) {
-                    e->way_ids.set(way.positive_id());
-                    for (const auto& nr : way.nodes()) {
-                        e->extra_node_ids.set(nr.ref());
-                    }
-                    return;
-                }
-            }
+            e->add_way(way);
         }
 
         void relation(const osmium::Relation& relation) {
@@ -106,24 +155,7 @@ namespace strategy_complete_ways {
         }
 
         void erelation(extract_data* e, const osmium::Relation& relation) {
-            for (const auto& member : relation.members()) {
-                switch (member.type()) {
-                    case osmium::item_type::node:
-                        if (e->node_ids.get(member.positive_ref())) {
-                            e->relation_ids.set(relation.positive_id());
-                            return;
-                        }
-                        break;
-                    case osmium::item_type::way:
-                        if (e->way_ids.get(member.positive_ref())) {
-                            e->relation_ids.set(relation.positive_id());
-                            return;
-                        }
-                        break;
-                    default:
-                        break;
-                }
-            }
+            e->add_relation(relation);
         }
 
         osmium::index::RelationsMapStash& relations_map_stash() noexcept {
@@ -161,9 +193,172 @@ namespace strategy_complete_ways {
 
     }; // class Pass2
 
+    // Used instead of Pass1 and Pass2 if a location index is set. The
+    // nodes inside and the ways in each extract are spooled to temporary
+    // files, the locations of all nodes are kept in the index, so the
+    // nodes outside the extracts needed to complete the ways can be
+    // created from the index at the end.
+    class SinglePass : public Pass<Strategy, SinglePass> {
+
+        osmium::handler::CheckOrder m_check_order;
+        osmium::index::RelationsMapStash m_relations_map_stash;
+        location_index_type* m_location_index;
+        BufferSpool* m_relations;
+
+    public:
+
+        static constexpr const bool enode_inside_only = true;
+
+        SinglePass(Strategy* strategy, location_index_type* location_index, BufferSpool* relations) :
+            Pass(strategy),
+            m_location_index(location_index),
+            m_relations(relations) {
+        }
+
+        void node(const osmium::Node& node) {
+            m_check_order.node(node);
+            m_location_index->set(node.positive_id(), node.location());
+        }
+
+        void enode_inside(extract_data* e, const osmium::Node& node) {
+            e->node_ids.set(node.positive_id());
+            e->node_spool->add(node);
+        }
+
+        void way(const osmium::Way& way) {
+            m_check_order.way(way);
+        }
+
+        void eway(extract_data* e, const osmium::Way& way) {
+            if (e->add_way(way)) {
+                e->way_spool->add(way);
+            }
+        }
+
+        void relation(const osmium::Relation& relation) {
+            m_check_order.relation(relation);
+            m_relations_map_stash.add_members(relation);
+            m_relations->add(relation);
+        }
+
+        void erelation(extract_data* e, const osmium::Relation& relation) {
+            e->add_relation(relation);
+        }
+
+        osmium::index::RelationsMapStash& relations_map_stash() noexcept {
+            return m_relations_map_stash;
+        }
+
+    }; // class SinglePass
+
+    // Write the nodes of the extract in ID order: The nodes inside the
+    // extract from the spool and, between them, the nodes needed to
+    // complete the ways created from the location index. The created
+    // nodes only have an ID and a location, no tags or metadata.
+    void Strategy::write_nodes(extract_data* e, const location_index_type& location_index) {
+        e->node_spool->rewind();
+        SpoolSource source{*e->node_spool};
+
+        const auto write_spooled_nodes_before = [&](osmium::unsigned_object_id_type id) {
+            while (!source.empty() && source.get()->positive_id() < id) {
+                e->write(*source.get());
+                source.next();
+            }
+        };
+
+        osmium::memory::Buffer buffer{1024, osmium::memory::Buffer::auto_grow::yes};
+        e->extra_node_ids.for_each([&](osmium::unsigned_object_id_type id) {
+            if (e->node_ids.get(id)) {
+                return;
+            }
+            const auto location = location_index.get_noexcept(id);
+            if (!location.valid()) {
+                return;
+            }
+            write_spooled_nodes_before(id);
+            {
+                osmium::builder::NodeBuilder builder{buffer};
+                builder.set_id(static_cast<osmium::object_id_type>(id));
+                builder.set_location(location);
+            }
+            buffer.commit();
+            for (const auto& node : buffer.select<osmium::Node>()) {
+                e->write(node);
+            }
+            buffer.clear();
+        });
+
+        write_spooled_nodes_before(std::numeric_limits<osmium::unsigned_object_id_type>::max());
+    }
+
+    void Strategy::run_single_pass(osmium::VerboseOutput& vout, bool display_progress, const osmium::io::File& input_file) {
+        vout << "Running 'complete_ways' strategy in one pass...\n";
+        const std::size_t file_size = input_file.filename().empty() ? 0 : osmium::file_size(input_file.filename());
+        osmium::ProgressBar progress_bar{file_size, display_progress};
+
+        const auto& map_factory = osmium::index::MapFactory<osmium::unsigned_object_id_type, osmium::Location>::instance();
+        auto location_index = map_factory.create_map(m_location_index_type);
+
+        BufferSpool relations{tmp_dir()};
+        for (auto& e : m_extracts) {
+            e.node_spool = std::make_unique<BufferSpool>(tmp_dir());
+            e.way_spool = std::make_unique<BufferSpool>(tmp_dir());
+        }
+
+        SinglePass pass{this, location_index.get(), &relations};
+        pass.run(progress_bar, input_file, m_read_types);
+        progress_bar.done();
+
+        if (m_read_types & osmium::osm_entity_bits::relation) {
+            // recursively get parents of all relations that are in an extract
+            const auto relations_map = pass.relations_map_stash().build_member_to_parent_index();
+            for (auto& e : m_extracts) {
+                e.relation_ids.for_each([&](osmium::unsigned_object_id_type id) {
+                    e.add_relation_parents(id, relations_map);
+                });
+            }
+        }
+
+        vout << "Writing nodes...\n";
+        location_index->sort();
+        for (auto& e : m_extracts) {
+            write_nodes(&e, *location_index);
+            e.node_spool.reset();
+        }
+        location_index.reset();
+
+        vout << "Writing ways...\n";
+        for (auto& e : m_extracts) {
+            e.way_spool->rewind();
+            while (const osmium::memory::Buffer buffer = e.way_spool->read()) {
+                for (const auto& way : buffer.select<osmium::Way>()) {
+                    e.write(way);
+                }
+            }
+            e.way_spool.reset();
+        }
+
+        vout << "Writing relations...\n";
+        relations.rewind();
+        while (const osmium::memory::Buffer buffer = relations.read()) {
+            for (const auto& relation : buffer.select<osmium::Relation>()) {
+                for (auto& e : m_extracts) {
+                    if (e.relation_ids.get(relation.positive_id())) {
+                        e.write(relation);
+                    }
+                }
+            }
+        }
+    }
+
     void Strategy::run(osmium::VerboseOutput& vout, bool display_progress, const osmium::io::File& input_file) {
+        if (!m_location_index_type.empty()) {
+            run_single_pass(vout, display_progress, input_file);
+            return;
+        }
+
         if (input_file.filename().empty()) {
-            throw osmium::io_error{"Can not read from STDIN when using 'complete_ways' strategy."};
+            throw osmium::io_error{"Can not read from STDIN when using 'complete_ways' strategy. Use --spool-stdin."};
         }
 
         vout << "Running 'complete_ways' strategy in two passes...\n";
@@ -179,16 +374,27 @@ namespace strategy_complete_ways {
             // recursively get parents of all relations that are in an extract
             const auto relations_map = pass1.relations_map_stash().build_member_to_parent_index();
             for (auto& e : m_extracts) {
-                for (const osmium::unsigned_object_id_type id : e.relation_ids) {
+                e.relation_ids.for_each([&](osmium::unsigned_object_id_type id) {
                     e.add_relation_parents(id, relations_map);
-                }
+                });
             }
         }
 
         progress_bar.remove();
         vout << "Second pass (of two)...\n";
         Pass2 pass2{this};
-        pass2.run(progress_bar, input_file, m_read_types);
+        // Without relations the blobs with relations can be skipped.
+        std::unique_ptr<PbfBlobIndex> blob_index;
+        if (!(m_read_types & osmium::osm_entity_bits::relation)) {
+            blob_index = PbfBlobIndex::create(input_file);
+        }
+        if (blob_index) {
+            PbfBlobSource source{*blob_index, m_read_types};
+            vout << "  Reading " << source.size() << " of " << blob_index->size() << " data blocks.\n";
+            pass2.run_source(progress_bar, source);
+        } else {
+            pass2.run(progress_bar, input_file, m_read_types);
+        }
 
         progress_bar.done();
     }
@@ -23,34 +23,71 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 */
 
+#include "id_set.hpp"
 #include "strategy.hpp"
 
-#include <osmium/index/id_set.hpp>
+#include "../sort/buffer_spool.hpp"
+
+#include <osmium/index/map.hpp>
 #include <osmium/index/relations_map.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/osm/way.hpp>
 
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace strategy_complete_ways {
 
     struct Data {
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> node_ids;
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> extra_node_ids;
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> way_ids;
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> relation_ids;
+        ExtractIdSet node_ids;
+        ExtractIdSet extra_node_ids;
+        ExtractIdSet way_ids;
+        ExtractIdSet relation_ids;
+
+        // Only used in single-pass mode: The nodes inside and the ways in
+        // the extract in the order they were read.
+        std::unique_ptr<BufferSpool> node_spool;
+        std::unique_ptr<BufferSpool> way_spool;
+
+        void set_id_set_type(id_set_type type) noexcept {
+            node_ids.set_type(type);
+            extra_node_ids.set_type(type);
+            way_ids.set_type(type);
+            relation_ids.set_type(type);
+        }
+
+        /**
+         * Add the way and all its nodes to the extract if any of its
+         * nodes are inside the extract. Returns true if it was added.
+         */
+        bool add_way(const osmium::Way& way);
+
+        /// Add the relation if any of its node or way members are in the extract.
+        void add_relation(const osmium::Relation& relation);
 
         void add_relation_parents(osmium::unsigned_object_id_type id, const osmium::index::RelationsMapIndex& map);
     };
 
+    using location_index_type = osmium::index::map::Map<osmium::unsigned_object_id_type, osmium::Location>;
+
     class Strategy : public ExtractStrategy {
 
         template <typename S, typename T>
         friend class ::Pass;
         friend class Pass1;
+        friend class SinglePass;
 
         using extract_data = ExtractData<Data>;
         std::vector<extract_data> m_extracts;
         osmium::osm_entity_bits::type m_read_types = osmium::osm_entity_bits::nwr;
+        std::string m_location_index_type;
+
+        void write_nodes(extract_data* e, const location_index_type& location_index);
+
+        void run_single_pass(osmium::VerboseOutput& vout, bool display_progress, const osmium::io::File& input_file);
 
     public:
 
@@ -58,6 +95,12 @@ namespace strategy_complete_ways {
 
         const char* name() const noexcept override final;
 
+        bool needs_multiple_passes() const noexcept override final {
+            return m_location_index_type.empty();
+        }
+
+        void show_arguments(osmium::VerboseOutput& vout) override final;
+
         void run(osmium::VerboseOutput& vout, bool display_progress, const osmium::io::File& input_file) override final;
 
     }; // class Strategy
@@ -37,11 +37,18 @@ namespace strategy_complete_ways_with_history {
         });
     }
 
-    Strategy::Strategy(const std::vector<std::unique_ptr<Extract>>& extracts, const osmium::Options& /*options*/) {
+    Strategy::Strategy(const std::vector<std::unique_ptr<Extract>>& extracts, const osmium::Options& options) {
         m_extracts.reserve(extracts.size());
         for (const auto& extract : extracts) {
             m_extracts.emplace_back(*extract);
         }
+
+        const auto id_sets = options.get("id-sets");
+        if (!id_sets.empty()) {
+            set_id_sets(id_sets);
+        }
+
+        init_id_sets(m_extracts);
     }
 
     const char* Strategy::name() const noexcept {
@@ -56,6 +63,8 @@ namespace strategy_complete_ways_with_history {
 
     public:
 
+        static constexpr const bool enode_inside_only = true;
+
         explicit Pass1(Strategy* strategy) :
             Pass(strategy) {
         }
@@ -71,10 +80,8 @@ namespace strategy_complete_ways_with_history {
             m_current_way_nodes.clear();
         }
 
-        void enode(extract_data* e, const osmium::Node& node) {
-            if (e->contains(node.location())) {
-                e->node_ids.set(node.positive_id());
-            }
+        void enode_inside(extract_data* e, const osmium::Node& node) {
+            e->node_ids.set(node.positive_id());
         }
 
         void way(const osmium::Way& way) {
@@ -159,7 +166,7 @@ namespace strategy_complete_ways_with_history {
 
     void Strategy::run(osmium::VerboseOutput& vout, bool display_progress, const osmium::io::File& input_file) {
         if (input_file.filename().empty()) {
-            throw osmium::io_error{"Can not read from STDIN when using 'complete_ways' strategy."};
+            throw osmium::io_error{"Can not read from STDIN when using 'complete_ways' strategy. Use --spool-stdin."};
         }
 
         vout << "Running 'complete_ways' strategy on history file in two passes...\n";
@@ -175,9 +182,9 @@ namespace strategy_complete_ways_with_history {
         // recursively get parents of all relations that are in an extract
         const auto relations_map = pass1.relations_map_stash().build_member_to_parent_index();
         for (auto& e : m_extracts) {
-            for (const osmium::unsigned_object_id_type id : e.relation_ids) {
+            e.relation_ids.for_each([&](osmium::unsigned_object_id_type id) {
                 e.add_relation_parents(id, relations_map);
-            }
+            });
         }
 
         progress_bar.remove();
@@ -23,9 +23,9 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 */
 
+#include "id_set.hpp"
 #include "strategy.hpp"
 
-#include <osmium/index/id_set.hpp>
 #include <osmium/index/relations_map.hpp>
 
 #include <memory>
@@ -34,10 +34,17 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 namespace strategy_complete_ways_with_history {
 
     struct Data {
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> node_ids;
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> extra_node_ids;
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> way_ids;
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> relation_ids;
+        ExtractIdSet node_ids;
+        ExtractIdSet extra_node_ids;
+        ExtractIdSet way_ids;
+        ExtractIdSet relation_ids;
+
+        void set_id_set_type(id_set_type type) noexcept {
+            node_ids.set_type(type);
+            extra_node_ids.set_type(type);
+            way_ids.set_type(type);
+            relation_ids.set_type(type);
+        }
 
         void add_relation_parents(osmium::unsigned_object_id_type id, const osmium::index::RelationsMapIndex& map);
     };
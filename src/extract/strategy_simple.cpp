@@ -39,8 +39,14 @@ namespace strategy_simple {
         }
 
         for (const auto& option : options) {
-            warning(std::string{"Ignoring unknown option '"} + option.first + "' for 'simple' strategy.\n");
+            if (option.first == "id-sets") {
+                set_id_sets(option.second);
+            } else {
+                warning(std::string{"Ignoring unknown option '"} + option.first + "' for 'simple' strategy.\n");
+            }
         }
+
+        init_id_sets(m_extracts);
     }
 
     const char* Strategy::name() const noexcept {
@@ -53,6 +59,8 @@ namespace strategy_simple {
 
     public:
 
+        static constexpr const bool enode_inside_only = true;
+
         explicit Pass1(Strategy* strategy) :
             Pass(strategy) {
         }
@@ -61,11 +69,9 @@ namespace strategy_simple {
             m_check_order.node(node);
         }
 
-        void enode(extract_data* e, const osmium::Node& node) {
-            if (e->contains(node.location())) {
-                e->write(node);
-                e->node_ids.set(node.positive_id());
-            }
+        void enode_inside(extract_data* e, const osmium::Node& node) {
+            e->write(node);
+            e->node_ids.set(node.positive_id());
         }
 
         void way(const osmium::Way& way) {
@@ -23,9 +23,9 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 */
 
+#include "id_set.hpp"
 #include "strategy.hpp"
 
-#include <osmium/index/id_set.hpp>
 
 #include <memory>
 #include <vector>
@@ -33,8 +33,13 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 namespace strategy_simple {
 
     struct Data {
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> node_ids;
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> way_ids;
+        ExtractIdSet node_ids;
+        ExtractIdSet way_ids;
+
+        void set_id_set_type(id_set_type type) noexcept {
+            node_ids.set_type(type);
+            way_ids.set_type(type);
+        }
     };
 
     class Strategy : public ExtractStrategy {
@@ -51,6 +56,10 @@ namespace strategy_simple {
 
         const char* name() const noexcept override final;
 
+        bool needs_multiple_passes() const noexcept override final {
+            return false;
+        }
+
         void run(osmium::VerboseOutput& vout, bool display_progress, const osmium::io::File& input_file) override final;
 
     }; // class Strategy
@@ -22,6 +22,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "strategy_smart.hpp"
 
+#include "pbf_blob_index.hpp"
+
 #include "../util.hpp"
 
 #include <osmium/handler/check_order.hpp>
@@ -85,6 +87,8 @@ namespace strategy_smart {
                         m_complete_partial_relations_percentage = 100;
                     }
                 }
+            } else if (option.first == "id-sets") {
+                set_id_sets(option.second);
             } else if (option.first == "tags") {
                 m_filter_tags = osmium::split_string(option.second, ',', true);
                 m_filter.set_default_result(false);
@@ -102,6 +106,8 @@ namespace strategy_smart {
                 warning(std::string{"Ignoring unknown option '"} + option.first + "' for 'smart' strategy.\n");
             }
         }
+
+        init_id_sets(m_extracts);
     }
 
     const char* Strategy::name() const noexcept {
@@ -170,6 +176,8 @@ namespace strategy_smart {
 
     public:
 
+        static constexpr const bool enode_inside_only = true;
+
         explicit Pass1(Strategy* strategy) :
             Pass(strategy) {
         }
@@ -178,10 +186,8 @@ namespace strategy_smart {
             m_check_order.node(node);
         }
 
-        void enode(extract_data* e, const osmium::Node& node) {
-            if (e->contains(node.location())) {
-                e->node_ids.set(node.positive_id());
-            }
+        void enode_inside(extract_data* e, const osmium::Node& node) {
+            e->node_ids.set(node.positive_id());
         }
 
         void way(const osmium::Way& way) {
@@ -298,7 +304,7 @@ namespace strategy_smart {
 
     void Strategy::run(osmium::VerboseOutput& vout, bool display_progress, const osmium::io::File& input_file) {
         if (input_file.filename().empty()) {
-            throw osmium::io_error{"Can not read from STDIN when using 'smart' strategy."};
+            throw osmium::io_error{"Can not read from STDIN when using 'smart' strategy. Use --spool-stdin."};
         }
 
         vout << "Running 'smart' strategy in three passes...\n";
@@ -313,15 +319,23 @@ namespace strategy_smart {
         // recursively get parents of all relations that are in an extract
         const auto relations_map = pass1.relations_map_stash().build_member_to_parent_index();
         for (auto& e : m_extracts) {
-            for (const osmium::unsigned_object_id_type id : e.relation_ids) {
+            e.relation_ids.for_each([&](osmium::unsigned_object_id_type id) {
                 e.add_relation_parents(id, relations_map);
-            }
+            });
         }
 
         progress_bar.remove();
         vout << "Second pass (of three)...\n";
         Pass2 pass2{this};
-        pass2.run(progress_bar, input_file, osmium::osm_entity_bits::way, osmium::io::read_meta::no);
+        // Only ways are needed, so skip the blobs with nodes and relations
+        // if possible.
+        if (auto blob_index = PbfBlobIndex::create(input_file)) {
+            PbfBlobSource source{*blob_index, osmium::osm_entity_bits::way, osmium::io::read_meta::no};
+            vout << "  Reading " << source.size() << " of " << blob_index->size() << " data blocks.\n";
+            pass2.run_source(progress_bar, source);
+        } else {
+            pass2.run(progress_bar, input_file, osmium::osm_entity_bits::way, osmium::io::read_meta::no);
+        }
         progress_bar.file_done(file_size);
 
         progress_bar.remove();
@@ -53,6 +53,10 @@ public:
         }
     }
 
+    bool empty() const noexcept {
+        return m_clean_attrs == 0;
+    }
+
     std::string to_string() const;
 }; // class OptionClean
 
@@ -0,0 +1,137 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "pbf_blob_reader.hpp"
+
+#include <osmium/io/detail/pbf_input_format.hpp>
+#include <osmium/io/error.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/entity_bits.hpp>
+
+#include <protozero/pbf_reader.hpp>
+
+#include <cerrno>
+#include <cstdint>
+#include <ios>
+#include <string>
+#include <system_error>
+#include <utility>
+
+namespace {
+
+// Maximum sizes allowed by the PBF format specification.
+constexpr const std::uint32_t max_blob_header_size = 64UL * 1024UL;
+constexpr const std::uint32_t max_uncompressed_blob_size = 32UL * 1024UL * 1024UL;
+
+} // anonymous namespace
+
+PbfBlobReader::PbfBlobReader(const std::string& filename) :
+    m_filename(filename),
+    m_stream(filename, std::ios::binary) {
+    if (!m_stream) {
+        throw std::system_error{errno, std::system_category(), "Could not open file '" + filename + "'"};
+    }
+    m_stream.seekg(0, std::ios::end);
+    m_file_size = static_cast<std::uint64_t>(m_stream.tellg());
+}
+
+void PbfBlobReader::read_exactly(std::uint64_t offset, char* data, std::size_t size) {
+    m_stream.seekg(static_cast<std::streamoff>(offset));
+    m_stream.read(data, static_cast<std::streamsize>(size));
+    if (!m_stream) {
+        throw osmium::pbf_error{"truncated data in file '" + m_filename + "'"};
+    }
+}
+
+bool PbfBlobReader::next(pbf_blob* blob) {
+    if (m_offset >= m_file_size) {
+        return false;
+    }
+    if (m_file_size - m_offset < 4) {
+        throw osmium::pbf_error{"truncated data in file '" + m_filename + "'"};
+    }
+
+    unsigned char size_data[4];
+    read_exactly(m_offset, reinterpret_cast<char*>(size_data), sizeof(size_data));
+    const std::uint32_t header_size = (static_cast<std::uint32_t>(size_data[0]) << 24U) |
+                                      (static_cast<std::uint32_t>(size_data[1]) << 16U) |
+                                      (static_cast<std::uint32_t>(size_data[2]) <<  8U) |
+                                       static_cast<std::uint32_t>(size_data[3]);
+    if (header_size > max_blob_header_size) {
+        throw osmium::pbf_error{"invalid BlobHeader size (> max_blob_header_size)"};
+    }
+
+    std::string header(header_size, '\0');
+    read_exactly(m_offset + 4, &header[0], header_size);
+
+    blob->type.clear();
+    blob->offset = m_offset;
+    blob->header_size = header_size;
+    blob->data_size = 0;
+
+    protozero::pbf_reader message{header};
+    while (message.next()) {
+        switch (message.tag_and_type()) {
+            case protozero::tag_and_type(1, protozero::pbf_wire_type::length_delimited): // type
+                blob->type = message.get_string();
+                break;
+            case protozero::tag_and_type(3, protozero::pbf_wire_type::varint): { // datasize
+                const auto size = message.get_int32();
+                if (size < 0 || static_cast<std::uint32_t>(size) > max_uncompressed_blob_size) {
+                    throw osmium::pbf_error{"invalid Blob size"};
+                }
+                blob->data_size = static_cast<std::uint32_t>(size);
+                break;
+            }
+            default:
+                message.skip();
+        }
+    }
+
+    if (blob->data_size == 0) {
+        throw osmium::pbf_error{"PBF format error: BlobHeader.datasize missing or zero."};
+    }
+
+    if (blob->end_offset() > m_file_size) {
+        throw osmium::pbf_error{"truncated data in file '" + m_filename + "'"};
+    }
+
+    m_offset = blob->end_offset();
+    return true;
+}
+
+std::string PbfBlobReader::read_data(const pbf_blob& blob) {
+    std::string data(blob.data_size, '\0');
+    read_exactly(blob.data_offset(), &data[0], blob.data_size);
+    return data;
+}
+
+std::string PbfBlobReader::read_blob(const pbf_blob& blob) {
+    std::string data(blob.end_offset() - blob.offset, '\0');
+    read_exactly(blob.offset, &data[0], data.size());
+    return data;
+}
+
+osmium::memory::Buffer decode_pbf_data_blob(std::string&& data, osmium::osm_entity_bits::type types, osmium::io::read_meta read_meta) {
+    osmium::io::detail::PBFDataBlobDecoder decoder{std::move(data), types, read_meta};
+    return decoder();
+}
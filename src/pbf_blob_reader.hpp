@@ -0,0 +1,117 @@
+#ifndef PBF_BLOB_READER_HPP
+#define PBF_BLOB_READER_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/io/reader.hpp> // for read_meta
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/entity_bits.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+/**
+ * Position and size of a blob (file block) in a PBF file.
+ */
+struct pbf_blob {
+
+    /// Blob type from the BlobHeader ("OSMHeader" or "OSMData").
+    std::string type;
+
+    /// Offset of the blob (including its length field) in the file.
+    std::uint64_t offset = 0;
+
+    /// Size of the BlobHeader message.
+    std::uint32_t header_size = 0;
+
+    /// Size of the Blob message.
+    std::uint32_t data_size = 0;
+
+    std::uint64_t data_offset() const noexcept {
+        return offset + 4 + header_size;
+    }
+
+    std::uint64_t end_offset() const noexcept {
+        return data_offset() + data_size;
+    }
+
+}; // struct pbf_blob
+
+/**
+ * Reads the blobs of a PBF file without decoding them. Blob headers are
+ * read with next(), the blob data is skipped unless it is read with
+ * read_data(). This allows scanning even huge files very quickly.
+ */
+class PbfBlobReader {
+
+    std::string m_filename;
+    std::ifstream m_stream;
+    std::uint64_t m_offset = 0;
+    std::uint64_t m_file_size = 0;
+
+    void read_exactly(std::uint64_t offset, char* data, std::size_t size);
+
+public:
+
+    explicit PbfBlobReader(const std::string& filename);
+
+    /**
+     * Read the header of the next blob and return it in *blob. Returns
+     * false at the end of the file. Throws osmium::pbf_error if the file
+     * is invalid.
+     */
+    bool next(pbf_blob* blob);
+
+    /// Read the (still encoded) Blob message of the blob.
+    std::string read_data(const pbf_blob& blob);
+
+    /**
+     * Read the complete blob as it is in the file, including the length
+     * field and the BlobHeader, so that it can be copied verbatim into
+     * another PBF file.
+     */
+    std::string read_blob(const pbf_blob& blob);
+
+    /// Continue reading blob headers at the given offset.
+    void seek(std::uint64_t offset) noexcept {
+        m_offset = offset;
+    }
+
+    std::uint64_t offset() const noexcept {
+        return m_offset;
+    }
+
+    std::uint64_t file_size() const noexcept {
+        return m_file_size;
+    }
+
+}; // class PbfBlobReader
+
+/**
+ * Decode the Blob message of an OSMData blob into a buffer with the OSM
+ * objects of the given types.
+ */
+osmium::memory::Buffer decode_pbf_data_blob(std::string&& data, osmium::osm_entity_bits::type types, osmium::io::read_meta read_meta = osmium::io::read_meta::yes);
+
+#endif // PBF_BLOB_READER_HPP
@@ -0,0 +1,222 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "buffer_spool.hpp"
+#include "merge_sorted.hpp"
+
+#include <osmium/memory/buffer.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+BufferSpool::BufferSpool(const std::string& directory) :
+    m_directory(directory) {
+}
+
+BufferSpool::BufferSpool(BufferSpool&& other) noexcept :
+    m_directory(std::move(other.m_directory)),
+    m_file(std::move(other.m_file)),
+    m_fp(other.m_fp),
+    m_chunk(std::move(other.m_chunk)),
+    m_bytes(other.m_bytes),
+    m_reading(other.m_reading) {
+    other.m_fp = nullptr;
+}
+
+BufferSpool& BufferSpool::operator=(BufferSpool&& other) noexcept {
+    if (this != &other) {
+        close_file();
+        m_directory = std::move(other.m_directory);
+        m_file = std::move(other.m_file);
+        m_fp = other.m_fp;
+        m_chunk = std::move(other.m_chunk);
+        m_bytes = other.m_bytes;
+        m_reading = other.m_reading;
+        other.m_fp = nullptr;
+    }
+    return *this;
+}
+
+BufferSpool::~BufferSpool() noexcept {
+    close_file();
+}
+
+namespace {
+
+std::FILE* open_stream(int fd, const char* mode) noexcept {
+#ifdef _WIN32
+    return ::_fdopen(fd, mode);
+#else
+    return ::fdopen(fd, mode);
+#endif
+}
+
+} // anonymous namespace
+
+void BufferSpool::close_file() noexcept {
+    if (m_fp) {
+        std::fclose(m_fp);
+        m_fp = nullptr;
+    }
+}
+
+void BufferSpool::write(const osmium::memory::Buffer& buffer) {
+    if (m_reading) {
+        throw std::logic_error{"Can not write to spool after rewind()"};
+    }
+
+    const std::uint64_t size = buffer.committed();
+    if (size == 0) {
+        return;
+    }
+
+    if (!m_fp) {
+        m_file = std::make_unique<TempFile>(m_directory, ".spool");
+        m_fp = open_stream(m_file->fd(), "w+b");
+        if (!m_fp) {
+            throw std::system_error{errno, std::system_category(), "Could not open temporary file '" + m_file->path() + "'"};
+        }
+        m_file->release_fd();
+    }
+
+    if (std::fwrite(&size, sizeof(size), 1, m_fp) != 1 ||
+        std::fwrite(buffer.data(), 1, size, m_fp) != size) {
+        throw std::system_error{errno, std::system_category(), "Could not write to temporary file '" + m_file->path() + "'"};
+    }
+
+    m_bytes += size;
+}
+
+void BufferSpool::add(const osmium::memory::Item& item) {
+    if (!m_chunk) {
+        m_chunk = osmium::memory::Buffer{chunk_size, osmium::memory::Buffer::auto_grow::yes};
+    } else if (m_chunk.committed() > 0 && m_chunk.capacity() - m_chunk.committed() < item.padded_size()) {
+        flush();
+    }
+    m_chunk.push_back(item);
+}
+
+void BufferSpool::flush() {
+    if (m_chunk && m_chunk.committed() > 0) {
+        write(m_chunk);
+        m_chunk.clear();
+    }
+}
+
+void BufferSpool::rewind() {
+    if (!m_reading) {
+        flush();
+        m_chunk = osmium::memory::Buffer{};
+        if (m_fp && std::fflush(m_fp) != 0) {
+            throw std::system_error{errno, std::system_category(), "Could not write to temporary file '" + m_file->path() + "'"};
+        }
+    }
+    m_reading = true;
+
+    // The file stays open, reading starts again at the beginning.
+    if (m_fp && std::fseek(m_fp, 0, SEEK_SET) != 0) {
+        throw std::system_error{errno, std::system_category(), "Could not rewind temporary file '" + m_file->path() + "'"};
+    }
+}
+
+osmium::memory::Buffer BufferSpool::read() {
+    if (!m_fp || !m_reading) {
+        return osmium::memory::Buffer{};
+    }
+
+    std::uint64_t size = 0;
+    if (std::fread(&size, sizeof(size), 1, m_fp) != 1) {
+        if (std::ferror(m_fp)) {
+            throw std::system_error{errno, std::system_category(), "Could not read from temporary file '" + m_file->path() + "'"};
+        }
+        // end of file, this data is not needed any more
+        close_file();
+        m_file.reset();
+        return osmium::memory::Buffer{};
+    }
+
+    osmium::memory::Buffer buffer{static_cast<std::size_t>(size), osmium::memory::Buffer::auto_grow::no};
+    unsigned char* data = buffer.reserve_space(static_cast<std::size_t>(size));
+    if (std::fread(data, 1, size, m_fp) != size) {
+        throw std::runtime_error{"Short read from temporary file '" + m_file->path() + "'"};
+    }
+    buffer.commit();
+
+    return buffer;
+}
+
+SpoolSource::SpoolSource(BufferSpool& spool) :
+    m_spool(&spool) {
+    next_buffer();
+}
+
+bool SpoolSource::next_buffer() {
+    while ((m_buffer = m_spool->read())) {
+        auto objects = m_buffer.select<osmium::OSMObject>();
+        m_it = objects.begin();
+        m_end = objects.end();
+        if (m_it != m_end) {
+            return true;
+        }
+    }
+    m_it = m_end = iterator{};
+    return false;
+}
+
+bool SpoolSource::next() {
+    ++m_it;
+    if (m_it != m_end) {
+        return true;
+    }
+    return next_buffer();
+}
+
+void merge_runs(std::vector<BufferSpool>* runs, std::size_t max_fan_in, const std::string& directory, osmium::VerboseOutput& vout) {
+    assert(max_fan_in > 1);
+    while (runs->size() > max_fan_in) {
+        vout << "Merging " << runs->size() << " runs into " << ((runs->size() + max_fan_in - 1) / max_fan_in) << " runs...\n";
+        std::vector<BufferSpool> merged_runs;
+        for (std::size_t i = 0; i < runs->size(); i += max_fan_in) {
+            const std::size_t end = std::min(i + max_fan_in, runs->size());
+            std::vector<SpoolSource> sources;
+            for (std::size_t n = i; n < end; ++n) {
+                (*runs)[n].rewind();
+                sources.emplace_back((*runs)[n]);
+            }
+            merged_runs.emplace_back(directory);
+            auto& out = merged_runs.back();
+            merge_sorted(sources, [&](const osmium::OSMObject& object) {
+                out.add(object);
+            });
+            out.flush();
+        }
+        *runs = std::move(merged_runs);
+    }
+}
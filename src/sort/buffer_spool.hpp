@@ -0,0 +1,139 @@
+#ifndef SORT_BUFFER_SPOOL_HPP
+#define SORT_BUFFER_SPOOL_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "../temp_file.hpp"
+
+#include <osmium/memory/buffer.hpp>
+#include <osmium/memory/item.hpp>
+#include <osmium/memory/item_iterator.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/util/verbose_output.hpp>
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * A temporary file holding a sequence of buffers in the native in-memory
+ * format. Writing and reading back doesn't need any encoding or decoding,
+ * all attributes of the objects are kept exactly as they are.
+ *
+ * Buffers are first written with write() (or single items with add()),
+ * after calling rewind() they can be read back with read() in the same
+ * order. The file is removed once it has been read completely or when
+ * the spool is destroyed.
+ */
+class BufferSpool {
+
+    static constexpr const std::size_t chunk_size = 1024UL * 1024UL;
+
+    // The temporary file is only created when the first buffer is
+    // written, so spools that stay empty don't use a file descriptor.
+    std::string m_directory;
+    std::unique_ptr<TempFile> m_file;
+    std::FILE* m_fp = nullptr;
+    osmium::memory::Buffer m_chunk{};
+    std::size_t m_bytes = 0;
+    bool m_reading = false;
+
+    void close_file() noexcept;
+
+public:
+
+    explicit BufferSpool(const std::string& directory);
+
+    BufferSpool(const BufferSpool&) = delete;
+    BufferSpool& operator=(const BufferSpool&) = delete;
+
+    BufferSpool(BufferSpool&& other) noexcept;
+    BufferSpool& operator=(BufferSpool&& other) noexcept;
+
+    ~BufferSpool() noexcept;
+
+    /// Append the committed contents of the buffer to the spool.
+    void write(const osmium::memory::Buffer& buffer);
+
+    /// Append a single item. Items are collected into chunks internally.
+    void add(const osmium::memory::Item& item);
+
+    /// Write out all items collected with add().
+    void flush();
+
+    /// Finish writing and prepare for reading from the beginning.
+    void rewind();
+
+    /// Read the next buffer. Returns an invalid buffer at the end.
+    osmium::memory::Buffer read();
+
+    /// Number of bytes of buffer data written to the spool.
+    std::size_t bytes() const noexcept {
+        return m_bytes;
+    }
+
+}; // class BufferSpool
+
+/**
+ * Iterates over all OSM objects in a BufferSpool. This has the get() and
+ * next() interface needed by merge_sorted().
+ */
+class SpoolSource {
+
+    using iterator = osmium::memory::ItemIterator<osmium::OSMObject>;
+
+    BufferSpool* m_spool;
+    osmium::memory::Buffer m_buffer;
+    iterator m_it;
+    iterator m_end;
+
+    bool next_buffer();
+
+public:
+
+    explicit SpoolSource(BufferSpool& spool);
+
+    bool empty() const noexcept {
+        return m_it == m_end;
+    }
+
+    const osmium::OSMObject* get() noexcept {
+        return &*m_it;
+    }
+
+    bool next();
+
+}; // class SpoolSource
+
+/**
+ * Merge the sorted runs in groups of max_fan_in runs into new runs (in
+ * the directory) until there are at most max_fan_in runs left. This
+ * keeps the number of open files and read buffers small when merging
+ * the runs in the end. Objects comparing equal stay in the order of the
+ * runs.
+ */
+void merge_runs(std::vector<BufferSpool>* runs, std::size_t max_fan_in, const std::string& directory, osmium::VerboseOutput& vout);
+
+#endif // SORT_BUFFER_SPOOL_HPP
@@ -0,0 +1,141 @@
+#ifndef SORT_LOSER_TREE_HPP
+#define SORT_LOSER_TREE_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/object.hpp>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * Tournament tree ("loser tree") for merging several sorted sources of
+ * OSM objects. Each inner node of the tree remembers the source which
+ * lost the comparison at that node, the overall winner is kept in node 0.
+ * After the winning source has been advanced, only the comparisons on
+ * the path from its leaf to the root have to be replayed, that's about
+ * log2(k) comparisons for k sources, and no elements are moved around
+ * like they are in a heap.
+ *
+ * Sources must have the member functions empty() and get(). Sources that
+ * are empty always lose. Objects that compare equal are ordered by the
+ * index of their source, so merging is stable.
+ */
+template <typename TSource>
+class LoserTree {
+
+    std::vector<TSource>* m_sources;
+    std::vector<std::size_t> m_nodes;
+
+    // Does the head of source a come before the head of source b?
+    bool beats(std::size_t a, std::size_t b) const {
+        auto& sa = (*m_sources)[a];
+        auto& sb = (*m_sources)[b];
+        if (sb.empty()) {
+            return !sa.empty() || a < b;
+        }
+        if (sa.empty()) {
+            return false;
+        }
+        const osmium::OSMObject& oa = *sa.get();
+        const osmium::OSMObject& ob = *sb.get();
+        if (oa < ob) {
+            return true;
+        }
+        if (ob < oa) {
+            return false;
+        }
+        return a < b;
+    }
+
+    // Play the tournament in the subtree at node, return the winner.
+    std::size_t build(std::size_t node) {
+        const std::size_t size = m_sources->size();
+        if (node >= size) {
+            return node - size;
+        }
+        const std::size_t left = build(2 * node);
+        const std::size_t right = build(2 * node + 1);
+        if (beats(left, right)) {
+            m_nodes[node] = right;
+            return left;
+        }
+        m_nodes[node] = left;
+        return right;
+    }
+
+public:
+
+    explicit LoserTree(std::vector<TSource>& sources) :
+        m_sources(&sources),
+        m_nodes(sources.empty() ? 1 : sources.size(), 0) {
+        if (sources.size() > 1) {
+            m_nodes[0] = build(1);
+        }
+    }
+
+    /// Are all sources empty?
+    bool empty() const {
+        return m_sources->empty() || (*m_sources)[m_nodes[0]].empty();
+    }
+
+    /// Index of the source with the smallest head.
+    std::size_t winner() const noexcept {
+        return m_nodes[0];
+    }
+
+    /**
+     * Index of the source with the smallest head apart from the winner
+     * or the number of sources if there is only one source. This is
+     * always one of the sources that lost against the winner on the
+     * way up the tree, so it takes about log2(k) comparisons to find.
+     */
+    std::size_t runner_up() const {
+        const std::size_t size = m_sources->size();
+        std::size_t best = size;
+        for (std::size_t node = (m_nodes[0] + size) / 2; node > 0; node /= 2) {
+            if (best == size || beats(m_nodes[node], best)) {
+                best = m_nodes[node];
+            }
+        }
+        return best;
+    }
+
+    /**
+     * Call this after the winning source has been advanced to restore
+     * the tree.
+     */
+    void replay() {
+        std::size_t winner = m_nodes[0];
+        for (std::size_t node = (winner + m_sources->size()) / 2; node > 0; node /= 2) {
+            if (beats(m_nodes[node], winner)) {
+                std::swap(m_nodes[node], winner);
+            }
+        }
+        m_nodes[0] = winner;
+    }
+
+}; // class LoserTree
+
+#endif // SORT_LOSER_TREE_HPP
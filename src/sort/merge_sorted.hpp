@@ -0,0 +1,53 @@
+#ifndef SORT_MERGE_SORTED_HPP
+#define SORT_MERGE_SORTED_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "loser_tree.hpp"
+
+#include <osmium/osm/object.hpp>
+
+#include <vector>
+
+/**
+ * Merge several sources of sorted OSM objects calling func for each
+ * object in order. Duplicate objects are not removed. Objects that
+ * compare equal are returned in the order of their sources, so the result
+ * is the same as the one from a stable sort of all objects.
+ *
+ * Sources must have the member functions empty(), get(), and next() (see
+ * SpoolSource for an example).
+ */
+template <typename TSource, typename TFunc>
+void merge_sorted(std::vector<TSource>& sources, TFunc&& func) {
+    LoserTree<TSource> tree{sources};
+
+    while (!tree.empty()) {
+        auto& source = sources[tree.winner()];
+        func(*source.get());
+        source.next();
+        tree.replay();
+    }
+}
+
+#endif // SORT_MERGE_SORTED_HPP
@@ -0,0 +1,329 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "object_sort.hpp"
+
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/object_comparisons.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Below this number of objects per thread, sorting in parallel isn't
+// worth the overhead.
+constexpr const std::size_t min_objects_per_thread = 10000;
+
+// Below this number of keys, radix sort isn't worth the overhead.
+constexpr const std::size_t min_radix_sort_size = 256;
+
+/**
+ * Call func(n) for all n from 0 to count - 1 using up to num_threads
+ * threads (including the current one).
+ */
+template <typename TFunc>
+void run_parallel(std::size_t count, unsigned int num_threads, TFunc&& func) {
+    if (num_threads <= 1 || count <= 1) {
+        for (std::size_t n = 0; n < count; ++n) {
+            func(n);
+        }
+        return;
+    }
+
+    std::atomic<std::size_t> next{0};
+    const auto worker = [&]() {
+        for (std::size_t n = next++; n < count; n = next++) {
+            func(n);
+        }
+    };
+
+    std::vector<std::future<void>> futures;
+    for (std::size_t n = 1; n < std::min<std::size_t>(num_threads, count); ++n) {
+        futures.push_back(std::async(std::launch::async, worker));
+    }
+    worker();
+    for (auto& future : futures) {
+        future.get();
+    }
+}
+
+/**
+ * Merge the sorted parts of the data using less(). Part n goes from
+ * bounds[n] to bounds[n + 1], bounds must start with 0 and end with the
+ * size of the data.
+ */
+template <typename T, typename TLess>
+void merge_parts(std::vector<T>* data, std::vector<std::size_t> bounds, unsigned int num_threads, TLess less) {
+    assert(!bounds.empty() && bounds.front() == 0 && bounds.back() == data->size());
+    if (bounds.size() <= 2) {
+        return;
+    }
+
+    // Merge neighbouring parts until only one is left. Data is merged back
+    // and forth between the original vector and a temporary one. Merging
+    // takes elements from the first part if they compare equal, so the
+    // result stays stable.
+    std::vector<T> temp(data->size());
+    std::vector<T>* source = data;
+    std::vector<T>* dest = &temp;
+
+    while (bounds.size() > 2) {
+        const std::size_t num_merges = (bounds.size() - 1) / 2;
+        run_parallel(num_merges, num_threads, [&](std::size_t n) {
+            const auto begin = bounds[n * 2];
+            const auto middle = bounds[n * 2 + 1];
+            const auto end = bounds[n * 2 + 2];
+            std::merge(source->begin() + begin, source->begin() + middle,
+                       source->begin() + middle, source->begin() + end,
+                       dest->begin() + begin, less);
+        });
+
+        std::vector<std::size_t> new_bounds;
+        for (std::size_t n = 0; n < num_merges; ++n) {
+            new_bounds.push_back(bounds[n * 2]);
+        }
+        if (bounds.size() % 2 == 0) { // odd number of parts, copy last one
+            const auto begin = bounds[bounds.size() - 2];
+            new_bounds.push_back(begin);
+            std::copy(source->begin() + begin, source->end(), dest->begin() + begin);
+        }
+        new_bounds.push_back(data->size());
+
+        bounds = std::move(new_bounds);
+        std::swap(source, dest);
+    }
+
+    if (source != data) {
+        *data = std::move(temp);
+    }
+}
+
+/**
+ * Sort data by calling sort_part() on parts of the data in parallel and
+ * merging the sorted parts using less() afterwards. Both must be stable.
+ */
+template <typename T, typename TSortPart, typename TLess>
+void parallel_sort(std::vector<T>* data, unsigned int num_threads, TSortPart&& sort_part, TLess less) {
+    const std::size_t size = data->size();
+    if (num_threads > size / min_objects_per_thread) {
+        num_threads = static_cast<unsigned int>(size / min_objects_per_thread);
+    }
+
+    if (num_threads <= 1) {
+        sort_part(data->begin(), data->end());
+        return;
+    }
+
+    // Boundaries of the parts sorted independently: part n goes from
+    // bounds[n] to bounds[n + 1].
+    std::vector<std::size_t> bounds;
+    bounds.reserve(num_threads + 1);
+    for (unsigned int n = 0; n < num_threads; ++n) {
+        bounds.push_back(size * n / num_threads);
+    }
+    bounds.push_back(size);
+
+    run_parallel(num_threads, num_threads, [&](std::size_t n) {
+        sort_part(data->begin() + bounds[n], data->begin() + bounds[n + 1]);
+    });
+
+    merge_parts(data, std::move(bounds), num_threads, less);
+}
+
+/**
+ * Key used for radix sorting. The id field contains the object type in
+ * the top 3 bits, then one bit which is set for positive IDs, and the
+ * absolute value of the ID in the remaining 60 bits. This gives the same
+ * order as osmium::object_order_type_id_version for type, ID, and version.
+ */
+struct sort_key {
+    uint64_t id;
+    uint32_t version;
+    const osmium::OSMObject* object;
+};
+
+constexpr const int type_shift = 61;
+constexpr const uint64_t positive_bit = 1ULL << 60U;
+constexpr const uint64_t max_positive_id = positive_bit - 1;
+
+bool key_less(const sort_key& lhs, const sort_key& rhs) noexcept {
+    return std::tie(lhs.id, lhs.version) < std::tie(rhs.id, rhs.version);
+}
+
+bool key_equal(const sort_key& lhs, const sort_key& rhs) noexcept {
+    return lhs.id == rhs.id && lhs.version == rhs.version;
+}
+
+// The key has 12 digits of one byte each, the 4 bytes of the version are
+// the least significant ones.
+constexpr const std::size_t num_digits = 12;
+
+std::size_t digit(const sort_key& key, std::size_t n) noexcept {
+    if (n < 4) {
+        return (key.version >> (n * 8U)) & 0xffU;
+    }
+    return (key.id >> ((n - 4) * 8U)) & 0xffU;
+}
+
+/**
+ * Stable LSD radix sort of the keys. The histograms for all digits are
+ * built in a single pass over the data. Digits where all keys have the
+ * same value (for instance the upper bytes of the ID or the type if only
+ * one type is sorted) are skipped.
+ */
+void radix_sort(std::vector<sort_key>::iterator begin, std::vector<sort_key>::iterator end) {
+    const auto size = static_cast<std::size_t>(end - begin);
+    if (size < min_radix_sort_size) {
+        std::stable_sort(begin, end, key_less);
+        return;
+    }
+
+    std::vector<std::array<std::size_t, 256>> counts(num_digits);
+    for (auto it = begin; it != end; ++it) {
+        for (std::size_t n = 0; n < num_digits; ++n) {
+            ++counts[n][digit(*it, n)];
+        }
+    }
+
+    std::vector<sort_key> temp(size);
+    auto source = begin;
+    auto dest = temp.begin();
+    bool in_temp = false;
+
+    for (std::size_t n = 0; n < num_digits; ++n) {
+        auto& count = counts[n];
+        if (count[digit(*source, n)] == size) {
+            continue;
+        }
+
+        std::size_t offset = 0;
+        for (auto& c : count) {
+            const auto this_count = c;
+            c = offset;
+            offset += this_count;
+        }
+
+        for (auto it = source; it != source + size; ++it) {
+            dest[count[digit(*it, n)]++] = *it;
+        }
+
+        std::swap(source, dest);
+        in_temp = !in_temp;
+    }
+
+    if (in_temp) {
+        std::copy(temp.begin(), temp.end(), begin);
+    }
+}
+
+bool sort_objects_radix(object_ptr_vector* objects, unsigned int num_threads) {
+    std::vector<sort_key> keys;
+    keys.reserve(objects->size());
+
+    for (const auto* object : *objects) {
+        const auto type = static_cast<uint64_t>(object->type());
+        const uint64_t id = object->positive_id();
+        if (type >= (1ULL << (64U - type_shift)) || id > max_positive_id) {
+            return false;
+        }
+        keys.push_back(sort_key{(type << type_shift) | (object->id() > 0 ? positive_bit : 0) | id,
+                                object->version(),
+                                object});
+    }
+
+    parallel_sort(&keys, num_threads, radix_sort, key_less);
+
+    // Objects with the same type, ID, and version are ordered by their
+    // timestamps (if they are set), which is not part of the key. They are
+    // still in input order here, so they can be sorted with the usual
+    // comparison function. This is very rare, so it doesn't matter that
+    // this is not done in parallel.
+    const osmium::object_order_type_id_version order{};
+    auto it = keys.begin();
+    while (it != keys.end()) {
+        auto group_end = std::find_if(std::next(it), keys.end(), [&](const sort_key& key) {
+            return !key_equal(*it, key);
+        });
+        if (std::distance(it, group_end) > 1) {
+            std::stable_sort(it, group_end, [&](const sort_key& lhs, const sort_key& rhs) {
+                return order(*lhs.object, *rhs.object);
+            });
+        }
+        it = group_end;
+    }
+
+    std::transform(keys.cbegin(), keys.cend(), objects->begin(), [](const sort_key& key) {
+        return key.object;
+    });
+
+    return true;
+}
+
+} // anonymous namespace
+
+void add_objects(const osmium::memory::Buffer& buffer, object_ptr_vector* objects) {
+    assert(objects);
+    for (const auto& object : buffer.select<osmium::OSMObject>()) {
+        objects->push_back(&object);
+    }
+}
+
+void sort_objects(object_ptr_vector* objects, unsigned int num_threads, sort_method method) {
+    assert(objects);
+
+    if (method == sort_method::radix && sort_objects_radix(objects, num_threads)) {
+        return;
+    }
+
+    const osmium::object_order_type_id_version order{};
+    parallel_sort(objects, num_threads, [&](object_ptr_vector::iterator begin, object_ptr_vector::iterator end) {
+        std::stable_sort(begin, end, order);
+    }, order);
+}
+
+bool objects_sorted(const object_ptr_vector& objects, std::size_t begin) {
+    assert(begin <= objects.size());
+    return std::is_sorted(objects.cbegin() + static_cast<std::ptrdiff_t>(begin), objects.cend(),
+                          osmium::object_order_type_id_version{});
+}
+
+void merge_sorted_parts(object_ptr_vector* objects, std::vector<std::size_t> bounds, unsigned int num_threads) {
+    assert(objects);
+    merge_parts(objects, std::move(bounds), num_threads, osmium::object_order_type_id_version{});
+}
+
+std::size_t sort_memory_per_object(sort_method method) noexcept {
+    if (method == sort_method::radix) {
+        return sizeof(const osmium::OSMObject*) + 2 * sizeof(sort_key);
+    }
+    return 2 * sizeof(const osmium::OSMObject*);
+}
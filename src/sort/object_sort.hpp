@@ -0,0 +1,82 @@
+#ifndef SORT_OBJECT_SORT_HPP
+#define SORT_OBJECT_SORT_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/object.hpp>
+
+#include <cstddef>
+#include <vector>
+
+using object_ptr_vector = std::vector<const osmium::OSMObject*>;
+
+enum class sort_method {
+    compare, // sort pointers using the object comparison function
+    radix    // radix sort on keys extracted from the objects
+};
+
+/**
+ * Add pointers to all OSM objects in the buffer to the vector.
+ */
+void add_objects(const osmium::memory::Buffer& buffer, object_ptr_vector* objects);
+
+/**
+ * Sort objects by type, ID, and version (see
+ * osmium::object_order_type_id_version).
+ *
+ * The sort is stable, objects comparing equal keep their relative order.
+ * So the result is always the same, regardless of the number of threads
+ * and the sort method used. If more than one thread is used, parts of the
+ * data are sorted in parallel and then merged, which needs an additional
+ * pointer per object.
+ *
+ * The radix sort method first copies the type, ID, version, and a
+ * pointer of each object into a compact array and sorts that, so the
+ * objects themselves don't have to be accessed for every comparison. This
+ * is much faster for large amounts of data, but needs more memory (see
+ * sort_memory_per_object()). If IDs are too large for the key, the
+ * compare method is used instead.
+ */
+void sort_objects(object_ptr_vector* objects, unsigned int num_threads, sort_method method = sort_method::compare);
+
+/**
+ * Are the objects from index begin to the end of the vector sorted?
+ */
+bool objects_sorted(const object_ptr_vector& objects, std::size_t begin = 0);
+
+/**
+ * Merge parts of the vector which are already sorted. Part n goes from
+ * bounds[n] to bounds[n + 1], bounds must start with 0 and end with the
+ * number of objects. Like sort_objects() this is stable and gives the
+ * same result as sorting all objects.
+ */
+void merge_sorted_parts(object_ptr_vector* objects, std::vector<std::size_t> bounds, unsigned int num_threads);
+
+/**
+ * Approximate number of bytes needed per object while sorting (in
+ * addition to the object itself).
+ */
+std::size_t sort_memory_per_object(sort_method method) noexcept;
+
+#endif // SORT_OBJECT_SORT_HPP
@@ -0,0 +1,144 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "sort_estimate.hpp"
+
+#include "../pbf_blob_reader.hpp"
+#include "../util.hpp"
+
+#include <osmium/io/file.hpp>
+#include <osmium/io/file_format.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/item_type.hpp>
+#include <osmium/osm/object.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// In-memory data of non-PBF files is roughly this many times larger than
+// the file (see "MEMORY USAGE" in the man page).
+constexpr const std::uint64_t non_pbf_factor = 10;
+
+struct blob_location {
+    std::size_t file;
+    pbf_blob blob;
+};
+
+// Objects and buffer bytes per type found in a decoded blob.
+struct blob_sample {
+    std::uint32_t data_size = 0;
+    std::array<std::uint64_t, 3> objects{{0, 0, 0}};
+    std::array<std::uint64_t, 3> data_bytes{{0, 0, 0}};
+};
+
+blob_sample decode_sample(PbfBlobReader& reader, const pbf_blob& blob) {
+    blob_sample sample;
+    sample.data_size = blob.data_size;
+
+    const osmium::memory::Buffer buffer = decode_pbf_data_blob(reader.read_data(blob), osmium::osm_entity_bits::nwr);
+
+    std::array<std::uint64_t, 3> bytes{{0, 0, 0}};
+    for (const auto& object : buffer.select<osmium::OSMObject>()) {
+        const auto index = osmium::item_type_to_nwr_index(object.type());
+        ++sample.objects[index];
+        bytes[index] += object.byte_size();
+    }
+
+    // The whole buffer is kept in memory, so distribute its capacity over
+    // the types in the buffer. Usually there is only one type per blob.
+    const std::uint64_t sum = bytes[0] + bytes[1] + bytes[2];
+    if (sum > 0) {
+        for (std::size_t i = 0; i < 3; ++i) {
+            sample.data_bytes[i] = buffer.capacity() * bytes[i] / sum;
+        }
+    }
+
+    return sample;
+}
+
+} // anonymous namespace
+
+sort_estimate estimate_sort_input(const std::vector<osmium::io::File>& files, std::size_t max_samples) {
+    sort_estimate estimate;
+
+    std::vector<std::unique_ptr<PbfBlobReader>> readers(files.size());
+    std::vector<blob_location> blobs;
+    for (std::size_t n = 0; n < files.size(); ++n) {
+        const auto& file = files[n];
+        if (file.format() != osmium::io::file_format::pbf) {
+            estimate.unknown_type_bytes += non_pbf_factor * file_size(file);
+            continue;
+        }
+
+        readers[n] = std::make_unique<PbfBlobReader>(file.filename());
+        pbf_blob blob;
+        while (readers[n]->next(&blob)) {
+            if (blob.type == "OSMData") {
+                blobs.push_back(blob_location{n, blob});
+            }
+        }
+    }
+
+    estimate.blobs = blobs.size();
+    if (blobs.empty() || max_samples == 0) {
+        return estimate;
+    }
+
+    // Decode evenly spread samples.
+    const std::size_t num_samples = std::min(max_samples, blobs.size());
+    std::vector<std::size_t> sample_indexes;
+    std::vector<blob_sample> samples;
+    for (std::size_t i = 0; i < num_samples; ++i) {
+        const std::size_t index = (2 * i + 1) * blobs.size() / (2 * num_samples);
+        const auto& location = blobs[index];
+        sample_indexes.push_back(index);
+        samples.push_back(decode_sample(*readers[location.file], location.blob));
+    }
+    estimate.sampled_blobs = samples.size();
+
+    // Extrapolate the numbers for each blob from the nearest sample
+    // scaled by the compressed size of the blobs.
+    for (std::size_t index = 0; index < blobs.size(); ++index) {
+        auto it = std::lower_bound(sample_indexes.cbegin(), sample_indexes.cend(), index);
+        if (it == sample_indexes.cend() ||
+            (it != sample_indexes.cbegin() && *it - index > index - *std::prev(it))) {
+            --it;
+        }
+        const auto& sample = samples[static_cast<std::size_t>(std::distance(sample_indexes.cbegin(), it))];
+        const std::uint64_t data_size = blobs[index].blob.data_size;
+        for (std::size_t i = 0; i < 3; ++i) {
+            estimate.objects[i] += sample.objects[i] * data_size / sample.data_size;
+            estimate.data_bytes[i] += sample.data_bytes[i] * data_size / sample.data_size;
+        }
+    }
+
+    return estimate;
+}
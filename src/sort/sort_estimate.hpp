@@ -0,0 +1,74 @@
+#ifndef SORT_SORT_ESTIMATE_HPP
+#define SORT_SORT_ESTIMATE_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/io/file.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Estimate of the amount of data osmium sort has to handle. Per-type
+ * numbers are indexed by osmium::item_type_to_nwr_index().
+ */
+struct sort_estimate {
+
+    /// Estimated number of objects per type (PBF input only).
+    std::array<std::uint64_t, 3> objects{{0, 0, 0}};
+
+    /// Estimated memory needed for the buffers per type (PBF input only).
+    std::array<std::uint64_t, 3> data_bytes{{0, 0, 0}};
+
+    /// Estimated memory needed for the buffers of non-PBF input.
+    std::uint64_t unknown_type_bytes = 0;
+
+    /// Number of data blobs in PBF input files.
+    std::uint64_t blobs = 0;
+
+    /// Number of data blobs actually decoded for the estimate.
+    std::uint64_t sampled_blobs = 0;
+
+    std::uint64_t total_objects() const noexcept {
+        return objects[0] + objects[1] + objects[2];
+    }
+
+    std::uint64_t total_data_bytes() const noexcept {
+        return data_bytes[0] + data_bytes[1] + data_bytes[2] + unknown_type_bytes;
+    }
+
+}; // struct sort_estimate
+
+/**
+ * Estimate the size of the data in the input files without reading all
+ * of them. For PBF files only the blob headers are read and up to
+ * max_samples data blobs (spread evenly over the files) are decoded. The
+ * numbers for the other blobs are extrapolated from the nearest sampled
+ * blob based on their compressed size. For other file formats the memory
+ * needed is estimated from the file size.
+ */
+sort_estimate estimate_sort_input(const std::vector<osmium::io::File>& files, std::size_t max_samples);
+
+#endif // SORT_SORT_ESTIMATE_HPP
@@ -0,0 +1,187 @@
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "temp_file.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+# include <io.h>
+# include <process.h>
+#else
+# include <unistd.h>
+#endif
+
+namespace {
+
+int process_id() noexcept {
+#ifdef _WIN32
+    return ::_getpid();
+#else
+    return static_cast<int>(::getpid());
+#endif
+}
+
+// Random characters for the file name, so the name can't be predicted.
+std::string random_chars() {
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    static std::random_device rd;
+    std::uniform_int_distribution<std::size_t> dist{0, sizeof(chars) - 2};
+
+    std::string result;
+    for (int i = 0; i < 8; ++i) {
+        result += chars[dist(rd)];
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+std::string default_tmp_dir() {
+    const char* dir = std::getenv("TMPDIR");
+    if (dir && dir[0] != '\0') {
+        return dir;
+    }
+#ifdef _WIN32
+    dir = std::getenv("TEMP");
+    if (dir && dir[0] != '\0') {
+        return dir;
+    }
+    return ".";
+#else
+    return "/tmp";
+#endif
+}
+
+TempFile::TempFile(const std::string& directory, const char* suffix) {
+    static std::atomic<unsigned int> counter{0};
+
+    std::string prefix = directory.empty() ? std::string{"."} : directory;
+    if (prefix.back() != '/') {
+        prefix += '/';
+    }
+    prefix += "osmium-";
+    prefix += std::to_string(process_id());
+    prefix += '-';
+    prefix += std::to_string(counter++);
+    prefix += '-';
+
+    int flags = O_RDWR | O_CREAT | O_EXCL; // NOLINT(hicpp-signed-bitwise)
+#ifdef _WIN32
+    flags |= O_BINARY; // NOLINT(hicpp-signed-bitwise)
+#endif
+
+    // O_EXCL makes sure we never open an existing file or follow a
+    // symlink. If the name is taken, try again with another one.
+    constexpr const int max_tries = 100;
+    for (int i = 0; i < max_tries; ++i) {
+        std::string path{prefix + random_chars() + suffix};
+        const int fd = ::open(path.c_str(), flags, 0600);
+        if (fd >= 0) {
+            m_path = std::move(path);
+            m_fd = fd;
+            return;
+        }
+        if (errno != EEXIST) {
+            throw std::system_error{errno, std::system_category(), "Could not create temporary file '" + path + "'"};
+        }
+    }
+
+    throw std::system_error{EEXIST, std::system_category(), "Could not create temporary file in '" + directory + "'"};
+}
+
+TempFile::TempFile(TempFile&& other) noexcept :
+    m_path(std::move(other.m_path)),
+    m_fd(other.m_fd) {
+    other.m_path.clear();
+    other.m_fd = -1;
+}
+
+TempFile& TempFile::operator=(TempFile&& other) noexcept {
+    if (this != &other) {
+        remove();
+        m_path = std::move(other.m_path);
+        m_fd = other.m_fd;
+        other.m_path.clear();
+        other.m_fd = -1;
+    }
+    return *this;
+}
+
+TempFile::~TempFile() noexcept {
+    remove();
+}
+
+int TempFile::release_fd() noexcept {
+    const int fd = m_fd;
+    m_fd = -1;
+    return fd;
+}
+
+bool TempFile::unchanged() const noexcept {
+    if (m_fd < 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return true;
+#else
+    struct stat fd_stat{};
+    struct stat path_stat{};
+    return ::fstat(m_fd, &fd_stat) == 0 &&
+           ::lstat(m_path.c_str(), &path_stat) == 0 &&
+           fd_stat.st_dev == path_stat.st_dev &&
+           fd_stat.st_ino == path_stat.st_ino;
+#endif
+}
+
+void TempFile::close() noexcept {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void TempFile::remove() noexcept {
+    close();
+    if (!m_path.empty()) {
+        std::remove(m_path.c_str());
+        m_path.clear();
+    }
+}
+
+void TempFile::rename(const std::string& path) {
+    close();
+    if (std::rename(m_path.c_str(), path.c_str()) != 0) {
+        throw std::system_error{errno, std::system_category(), "Could not rename temporary file '" + m_path + "' to '" + path + "'"};
+    }
+    m_path.clear();
+}
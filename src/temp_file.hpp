@@ -0,0 +1,106 @@
+#ifndef TEMP_FILE_HPP
+#define TEMP_FILE_HPP
+
+/*
+
+Osmium -- OpenStreetMap data manipulation command line tool
+https://osmcode.org/osmium-tool/
+
+Copyright (C) 2013-2026  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <string>
+
+/// The directory for temporary files: $TMPDIR if set, otherwise /tmp.
+std::string default_tmp_dir();
+
+/**
+ * A temporary file. The file is created with a unique name in the given
+ * directory when the object is constructed. It is created atomically and
+ * only if no file with that name exists yet, so it can't be a symlink or
+ * a file that was put there by somebody else. The name contains random
+ * characters and can not be guessed in advance.
+ *
+ * The file is removed when the object is destroyed.
+ */
+class TempFile {
+
+    std::string m_path;
+    int m_fd = -1;
+
+public:
+
+    /**
+     * Create temporary file in the directory.
+     *
+     * @throws std::system_error if the file can not be created.
+     */
+    TempFile(const std::string& directory, const char* suffix);
+
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+
+    TempFile(TempFile&& other) noexcept;
+    TempFile& operator=(TempFile&& other) noexcept;
+
+    ~TempFile() noexcept;
+
+    const std::string& path() const noexcept {
+        return m_path;
+    }
+
+    /**
+     * The file descriptor of the open file (opened for reading and
+     * writing) or -1 if it was released or closed.
+     */
+    int fd() const noexcept {
+        return m_fd;
+    }
+
+    /**
+     * Give up ownership of the file descriptor. The caller is then
+     * responsible for closing it. The file is still removed when this
+     * object is destroyed.
+     */
+    int release_fd() noexcept;
+
+    /**
+     * Check that the path still refers to the file created by this
+     * object. Use this when the file has to be opened again by name,
+     * for instance by an osmium::io::Writer. Always returns false if
+     * the file descriptor has been released or closed.
+     */
+    bool unchanged() const noexcept;
+
+    /// Close the file descriptor (if it is still owned by this object).
+    void close() noexcept;
+
+    /// Close and remove the file now (if it exists).
+    void remove() noexcept;
+
+    /**
+     * Close the file and rename it to path, replacing any file with that
+     * name. After that the file is not removed on destruction any more.
+     * It stays in place if the rename fails.
+     *
+     * @throws std::system_error if the file can not be renamed.
+     */
+    void rename(const std::string& path);
+
+}; // class TempFile
+
+#endif // TEMP_FILE_HPP
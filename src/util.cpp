@@ -38,6 +38,10 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <utility>
 #include <vector>
 
+#ifndef _WIN32
+# include <unistd.h>
+#endif
+
 /**
  * Get the suffix of the given file name. The suffix is everything after
  * the *first* dot (.). So multiple suffixes will all be returned.
@@ -276,3 +280,17 @@ double show_gbytes(std::size_t value) noexcept {
     return static_cast<double>(show_mbytes(value)) / 1000; // NOLINT(bugprone-integer-division)
 }
 
+/**
+ * Return the amount of physical memory in bytes or 0 if it can not be
+ * determined.
+ */
+std::size_t physical_memory() noexcept {
+#if defined(_SC_PHYS_PAGES) && defined(_SC_PAGESIZE)
+    const long pages = ::sysconf(_SC_PHYS_PAGES); // NOLINT(google-runtime-int)
+    const long page_size = ::sysconf(_SC_PAGESIZE); // NOLINT(google-runtime-int)
+    if (pages > 0 && page_size > 0) {
+        return static_cast<std::size_t>(pages) * static_cast<std::size_t>(page_size);
+    }
+#endif
+    return 0;
+}
@@ -1,14 +1,33 @@
 
 #include "test.hpp" // IWYU pragma: keep
 
+#include "buffer_budget.hpp"
+#include "crossing_kernel.hpp"
+#include "envelope_index.hpp"
 #include "exception.hpp"
+#include "extract_bbox.hpp"
+#include "extract_polygon.hpp"
 #include "geojson_file_parser.hpp"
 #include "geometry_util.hpp"
+#include "id_set.hpp"
+#include "option_clean.hpp"
 #include "osm_file_parser.hpp"
 #include "poly_file_parser.hpp"
+#include "temp_file.hpp"
 
+#include <osmium/builder/attr.hpp>
+#include <osmium/io/file.hpp>
+#include <osmium/io/header.hpp>
+#include <osmium/io/writer_options.hpp>
 #include <osmium/memory/buffer.hpp>
-
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <utility>
 #include <vector>
 
 TEST_CASE("Parse poly files") {
@@ -259,3 +278,344 @@ TEST_CASE("Ring orientation (counter-clockwise)") {
     REQUIRE(is_ccw(c));
 }
 
+
+TEST_CASE("Envelope index") {
+    const std::vector<osmium::Box> envelopes = {
+        osmium::Box{osmium::Location{0.0, 0.0}, osmium::Location{1.5, 10.0}},
+        osmium::Box{osmium::Location{-10.0, -10.0}, osmium::Location{-5.0, -5.0}},
+        osmium::Box{osmium::Location{1.0, 1.0}, osmium::Location{20.0, 20.0}},
+        osmium::Box{osmium::Location{-180.0, -90.0}, osmium::Location{180.0, 90.0}}
+    };
+    const EnvelopeIndex index{envelopes};
+
+    const auto candidates = [&](const osmium::Location& location) {
+        std::vector<std::size_t> result;
+        index.for_each(location, [&](std::size_t n) {
+            result.push_back(n);
+        });
+        return result;
+    };
+
+    REQUIRE(candidates(osmium::Location{1.2, 1.2}) == std::vector<std::size_t>({0, 2, 3}));
+    REQUIRE(candidates(osmium::Location{-7.0, -7.0}) == std::vector<std::size_t>({1, 3}));
+    REQUIRE(candidates(osmium::Location{100.0, 50.0}) == std::vector<std::size_t>({3}));
+    REQUIRE(candidates(osmium::Location{180.0, 90.0}) == std::vector<std::size_t>({3}));
+    REQUIRE(candidates(osmium::Location{}).empty());
+}
+
+TEST_CASE("Envelope index with several envelopes per extract") {
+    const std::vector<std::vector<osmium::Box>> envelopes = {
+        {osmium::Box{osmium::Location{170.0, 50.0}, osmium::Location{180.0, 55.0}},
+         osmium::Box{osmium::Location{-180.0, 50.0}, osmium::Location{-130.0, 72.0}}},
+        {osmium::Box{osmium::Location{0.0, 0.0}, osmium::Location{10.0, 10.0}},
+         osmium::Box{osmium::Location{5.0, 5.0}, osmium::Location{15.0, 15.0}}}
+    };
+    const EnvelopeIndex index{envelopes};
+
+    const auto candidates = [&](const osmium::Location& location) {
+        std::vector<std::size_t> result;
+        index.for_each(location, [&](std::size_t n) {
+            result.push_back(n);
+        });
+        return result;
+    };
+
+    REQUIRE(candidates(osmium::Location{175.0, 52.0}) == std::vector<std::size_t>({0}));
+    REQUIRE(candidates(osmium::Location{-150.0, 65.0}) == std::vector<std::size_t>({0}));
+    REQUIRE(candidates(osmium::Location{0.0, 60.0}).empty());
+    REQUIRE(candidates(osmium::Location{7.0, 7.0}) == std::vector<std::size_t>({1}));
+    REQUIRE(candidates(osmium::Location{12.0, 12.0}) == std::vector<std::size_t>({1}));
+}
+
+TEST_CASE("Polygon raster gives same results as checking segments") {
+    osmium::memory::Buffer buffer{1024};
+    PolyFileParser parser{buffer, "test/extract/polygon-us-alaska.poly"};
+    const auto offset = parser();
+
+    const osmium::io::File file{"out.osm"};
+    const ExtractPolygon without_raster{file, "", buffer, offset, 0};
+    const ExtractPolygon with_raster{file, "", buffer, offset, 64};
+    REQUIRE(without_raster.raster_size() == 0);
+    REQUIRE(with_raster.raster_size() == 64);
+    REQUIRE(with_raster.raster_boundary_cells() > 0);
+    REQUIRE(with_raster.raster_boundary_cells() < 64 * 64);
+
+    const auto& envelope = with_raster.envelope();
+    const int32_t steps = 200;
+    const int32_t dx = (envelope.top_right().x() - envelope.bottom_left().x()) / steps;
+    const int32_t dy = (envelope.top_right().y() - envelope.bottom_left().y()) / steps;
+    for (int32_t i = 0; i <= steps; ++i) {
+        for (int32_t j = 0; j <= steps; ++j) {
+            const osmium::Location location{envelope.bottom_left().x() + i * dx, envelope.bottom_left().y() + j * dy};
+            REQUIRE(with_raster.contains(location) == without_raster.contains(location));
+        }
+    }
+}
+
+TEST_CASE("Checking locations in batches gives same results as one by one") {
+    osmium::memory::Buffer buffer{1024};
+    PolyFileParser parser{buffer, "test/extract/polygon-us-alaska.poly"};
+    const auto offset = parser();
+
+    const osmium::io::File file{"out.osm"};
+    const ExtractPolygon polygon{file, "", buffer, offset};
+    const ExtractBBox bbox{file, "", osmium::Box{osmium::Location{-160.0, 55.0}, osmium::Location{-140.0, 65.0}}};
+
+    std::vector<osmium::Location> locations;
+    for (int i = 0; i <= 100; ++i) {
+        for (int j = 0; j <= 100; ++j) {
+            locations.emplace_back(-180.0 + i * 0.5, 45.0 + j * 0.3);
+        }
+    }
+    locations.emplace_back();
+
+    for (const Extract* extract : {static_cast<const Extract*>(&polygon), static_cast<const Extract*>(&bbox)}) {
+        std::vector<bool> results{true, false};
+        extract->contains_batch(locations, &results);
+        REQUIRE(results.size() == locations.size());
+        for (std::size_t n = 0; n < locations.size(); ++n) {
+            REQUIRE(results[n] == extract->contains(locations[n]));
+        }
+        REQUIRE_FALSE(results.back());
+    }
+}
+
+TEST_CASE("Polygon crossing the antimeridian is split into parts") {
+    osmium::memory::Buffer buffer{1024};
+    PolyFileParser parser{buffer, "test/extract/polygon-us-alaska.poly"};
+    const auto offset = parser();
+
+    const osmium::io::File file{"out.osm"};
+    const ExtractPolygon polygon{file, "", buffer, offset};
+    REQUIRE(polygon.parts() == 2);
+
+    const auto envelopes = polygon.envelopes();
+    REQUIRE(envelopes.size() == 2);
+    REQUIRE(envelopes[0].bottom_left().lon() > 0.0);
+    REQUIRE(envelopes[1].top_right().lon() < 0.0);
+
+    REQUIRE(polygon.contains(osmium::Location{-150.0, 65.0}));
+    REQUIRE(polygon.contains(osmium::Location{175.0, 52.5}));
+    REQUIRE_FALSE(polygon.contains(osmium::Location{0.0, 60.0}));
+    REQUIRE_FALSE(polygon.contains(osmium::Location{175.0, 60.0}));
+    REQUIRE_FALSE(polygon.contains(osmium::Location{-175.0, 45.0}));
+
+    const ExtractPolygon copy{file, "", buffer, offset, polygon.prepared()};
+    REQUIRE(copy.parts() == 2);
+    REQUIRE(copy.contains(osmium::Location{175.0, 52.5}));
+    REQUIRE_FALSE(copy.contains(osmium::Location{175.0, 60.0}));
+}
+
+TEST_CASE("Polygon not crossing the antimeridian has one part") {
+    osmium::memory::Buffer buffer{1024};
+    PolyFileParser parser{buffer, "test/extract/polygon-two-outer.poly"};
+    const auto offset = parser();
+
+    const osmium::io::File file{"out.osm"};
+    const ExtractPolygon polygon{file, "", buffer, offset};
+    REQUIRE(polygon.parts() == 1);
+    REQUIRE(polygon.envelopes().size() == 1);
+}
+
+TEST_CASE("Bands of polygon are smaller where there are many segments") {
+    osmium::memory::Buffer buffer{1024};
+    PolyFileParser parser{buffer, "test/extract/polygon-coast.poly"};
+    const auto offset = parser();
+
+    // Most of the segments are in a very narrow y range at the bottom.
+    const osmium::io::File file{"out.osm"};
+    const ExtractPolygon polygon{file, "", buffer, offset, 0};
+    REQUIRE(polygon.max_band_segments() <= 40);
+
+    REQUIRE(polygon.contains(osmium::Location{5.0, 1.0}));
+    REQUIRE(polygon.contains(osmium::Location{1.875, 0.0001}));
+    REQUIRE_FALSE(polygon.contains(osmium::Location{0.625, 0.0099}));
+    REQUIRE_FALSE(polygon.contains(osmium::Location{5.0, -0.5}));
+
+    const ExtractPolygon copy{file, "", buffer, offset, polygon.prepared()};
+    REQUIRE(copy.max_band_segments() == polygon.max_band_segments());
+    REQUIRE(copy.contains(osmium::Location{1.875, 0.0001}));
+}
+
+TEST_CASE("Crossing kernel gives same results as scalar version") {
+    std::mt19937 gen{42};
+    std::uniform_int_distribution<int32_t> dist_x{-1800000000, 1800000000};
+    std::uniform_int_distribution<int32_t> dist_y{-900000000, 900000000};
+
+    for (std::size_t size = 0; size < 30; ++size) {
+        std::vector<int32_t> x1(size);
+        std::vector<int32_t> y1(size);
+        std::vector<int32_t> x2(size);
+        std::vector<int32_t> y2(size);
+        for (std::size_t n = 0; n < size; ++n) {
+            x1[n] = dist_x(gen);
+            y1[n] = dist_y(gen);
+            x2[n] = x1[n] + 10 * (static_cast<int32_t>(n) - 15);
+            y2[n] = y1[n] - 20 * (static_cast<int32_t>(n) - 14);
+        }
+        const band_segments segments{x1.data(), y1.data(), x2.data(), y2.data(), size};
+
+        for (std::size_t n = 0; n < size; ++n) {
+            // on the segment, exactly at the end points, and next to it
+            for (int32_t t = -1; t <= 11; ++t) {
+                const int32_t x = x1[n] + (x2[n] - x1[n]) / 10 * t;
+                const int32_t y = y1[n] + (y2[n] - y1[n]) / 10 * t;
+                REQUIRE(location_in_band(segments, x, y) == location_in_band_scalar(segments, x, y));
+                REQUIRE(location_in_band(segments, x + 1, y) == location_in_band_scalar(segments, x + 1, y));
+            }
+        }
+        for (int i = 0; i < 100; ++i) {
+            const int32_t x = dist_x(gen);
+            const int32_t y = dist_y(gen);
+            REQUIRE(location_in_band(segments, x, y) == location_in_band_scalar(segments, x, y));
+        }
+    }
+}
+
+TEST_CASE("Compressed ID set") {
+    CompressedIdSet set;
+    REQUIRE(set.empty());
+
+    // sparse IDs (array containers)
+    set.set(17);
+    set.set(5);
+    set.set(12000000000ULL);
+    set.set(17);
+
+    // consecutive IDs (run container)
+    for (osmium::unsigned_object_id_type id = 1000000; id < 1010000; ++id) {
+        set.set(id);
+    }
+
+    // many scattered IDs in one chunk (bitmap container)
+    for (osmium::unsigned_object_id_type id = 2000000; id < 2060000; id += 3) {
+        set.set(id);
+    }
+
+    REQUIRE(set.size() == 3 + 10000 + 20000);
+    REQUIRE(set.get(5));
+    REQUIRE(set.get(17));
+    REQUIRE_FALSE(set.get(6));
+    REQUIRE(set.get(12000000000ULL));
+    REQUIRE_FALSE(set.get(12000000001ULL));
+    REQUIRE(set.get(1000000));
+    REQUIRE(set.get(1009999));
+    REQUIRE_FALSE(set.get(1010000));
+    REQUIRE(set.get(2000003));
+    REQUIRE_FALSE(set.get(2000004));
+    REQUIRE(set.used_memory() < 100000);
+
+    osmium::unsigned_object_id_type id = 18;
+    REQUIRE(set.next(&id));
+    REQUIRE(id == 1000000);
+    id = 12000000001ULL;
+    REQUIRE_FALSE(set.next(&id));
+
+    std::size_t count = 0;
+    osmium::unsigned_object_id_type last = 0;
+    set.for_each([&](osmium::unsigned_object_id_type n) {
+        REQUIRE((count == 0 || n > last));
+        last = n;
+        ++count;
+    });
+    REQUIRE(count == set.size());
+    REQUIRE(last == 12000000000ULL);
+
+    CompressedIdSet moved{std::move(set)};
+    REQUIRE(moved.size() == 3 + 10000 + 20000);
+    moved.set(1010000);
+    REQUIRE(moved.get(1010000));
+    REQUIRE(moved.get(1000000));
+
+    set = std::move(moved);
+    set.set(1010001);
+    REQUIRE(set.get(1010001));
+    REQUIRE(set.size() == 3 + 10000 + 20000 + 2);
+}
+
+TEST_CASE("Compressed ID set: IDs added in for_each are visited") {
+    CompressedIdSet set;
+    for (osmium::unsigned_object_id_type id = 1; id < 200000; id += 7) {
+        set.set(id);
+    }
+
+    // Adds IDs in the same container and in containers that do not exist
+    // yet, turning the array containers into run or bitmap containers.
+    std::vector<osmium::unsigned_object_id_type> visited;
+    set.for_each([&](osmium::unsigned_object_id_type id) {
+        visited.push_back(id);
+        if (id < 300000) {
+            set.set(id * 2 + 1);
+            set.set(id + 1);
+        }
+    });
+
+    REQUIRE(visited.size() == set.size());
+    REQUIRE(std::is_sorted(visited.begin(), visited.end()));
+    REQUIRE(std::adjacent_find(visited.begin(), visited.end()) == visited.end());
+    REQUIRE(set.get(599999));
+    REQUIRE(visited.back() == 599999);
+}
+
+TEST_CASE("Buffer budget") {
+    BufferBudget budget{1000, 3};
+    REQUIRE(budget.memory_for(10) == 40);
+
+    REQUIRE(budget.try_take(600));
+    REQUIRE_FALSE(budget.try_take(500));
+    REQUIRE(budget.used() == 600);
+
+    budget.take(500);
+    REQUIRE(budget.used() == 1100);
+
+    budget.give_back(1100);
+    REQUIRE(budget.used() == 0);
+    REQUIRE(budget.peak() == 1100);
+}
+
+namespace {
+
+// Write enough nodes into the extract to fill several output buffers.
+void write_nodes(Extract* extract) {
+    using namespace osmium::builder::attr; // NOLINT(google-build-using-namespace)
+
+    osmium::memory::Buffer buffer{1024, osmium::memory::Buffer::auto_grow::yes};
+    for (osmium::object_id_type id = 1; id <= 20000; ++id) {
+        osmium::builder::add_node(buffer, _id(id), _location(1.0, 1.0), _tag("name", "some node with a name"));
+    }
+    for (const auto& item : buffer) {
+        extract->write(item);
+    }
+}
+
+} // anonymous namespace
+
+TEST_CASE("Output buffers of extract grow while the budget allows it") {
+    const TempFile output{default_tmp_dir(), ".opl"};
+    ExtractBBox extract{osmium::io::File{output.path(), "opl"}, "", osmium::Box{osmium::Location{0.0, 0.0}, osmium::Location{2.0, 2.0}}};
+    extract.set_buffer_size(Extract::min_buffer_size * 4);
+
+    const OptionClean clean;
+
+    SECTION("enough memory") {
+        BufferBudget budget{100UL * 1024UL * 1024UL, 2};
+        extract.set_buffer_budget(&budget);
+        extract.open_file(osmium::io::Header{}, osmium::io::overwrite::allow, osmium::io::fsync::no, &clean);
+        REQUIRE(budget.used() == 0);
+        write_nodes(&extract);
+        REQUIRE(budget.used() == budget.memory_for(Extract::min_buffer_size * 4));
+        extract.close_file();
+        REQUIRE(budget.used() == 0);
+    }
+
+    SECTION("budget only allows smallest buffers") {
+        BufferBudget budget{(2 + 1) * Extract::min_buffer_size, 2};
+        extract.set_buffer_budget(&budget);
+        extract.open_file(osmium::io::Header{}, osmium::io::overwrite::allow, osmium::io::fsync::no, &clean);
+        write_nodes(&extract);
+        REQUIRE(budget.used() == budget.memory_for(Extract::min_buffer_size));
+        REQUIRE(budget.peak() == budget.memory_for(Extract::min_buffer_size));
+        extract.close_file();
+        REQUIRE(budget.used() == 0);
+    }
+}
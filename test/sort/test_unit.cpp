@@ -0,0 +1,206 @@
+#include "test.hpp" // IWYU pragma: keep
+
+#include "sort/buffer_spool.hpp"
+#include "sort/merge_sorted.hpp"
+#include "sort/object_sort.hpp"
+#include "temp_file.hpp"
+
+#include <osmium/builder/attr.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/item_type.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/object_comparisons.hpp>
+#include <osmium/osm/timestamp.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/util/verbose_output.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+/**
+ * Fill buffer with objects of all types in random order. There are
+ * negative and positive IDs, several versions of most objects, and many
+ * objects with the same type, ID, and version (and timestamp). The
+ * changeset ID is set to the position of the object in the input, so
+ * the order of objects comparing equal can be checked.
+ */
+void add_random_objects(osmium::memory::Buffer* buffer, std::size_t count, osmium::object_id_type max_id) {
+    using namespace osmium::builder::attr; // NOLINT(google-build-using-namespace)
+
+    std::mt19937 gen{17};
+    std::uniform_int_distribution<int> dist_type{0, 2};
+    std::uniform_int_distribution<osmium::object_id_type> dist_id{-max_id, max_id};
+    std::uniform_int_distribution<osmium::object_version_type> dist_version{1, 3};
+
+    const osmium::Timestamp timestamp{"2020-01-01T00:00:00Z"};
+    for (std::size_t n = 0; n < count; ++n) {
+        const auto id = dist_id(gen);
+        const auto version = dist_version(gen);
+        const auto changeset = static_cast<osmium::changeset_id_type>(n + 1);
+        switch (dist_type(gen)) {
+            case 0:
+                osmium::builder::add_node(*buffer, _id(id), _version(version), _cid(changeset), _timestamp(timestamp));
+                break;
+            case 1:
+                osmium::builder::add_way(*buffer, _id(id), _version(version), _cid(changeset), _timestamp(timestamp));
+                break;
+            default:
+                osmium::builder::add_relation(*buffer, _id(id), _version(version), _cid(changeset), _timestamp(timestamp));
+                break;
+        }
+    }
+}
+
+// The result of a stable sort with the usual comparison function.
+object_ptr_vector reference_sort(object_ptr_vector objects) {
+    std::stable_sort(objects.begin(), objects.end(), osmium::object_order_type_id_version{});
+    return objects;
+}
+
+// Check that objects comparing equal are still in input order.
+bool equal_objects_in_input_order(const object_ptr_vector& objects) {
+    const osmium::object_order_type_id_version order{};
+    for (std::size_t n = 1; n < objects.size(); ++n) {
+        if (!order(*objects[n - 1], *objects[n]) &&
+            objects[n - 1]->changeset() > objects[n]->changeset()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Radix sort gives same order as comparing objects") {
+    osmium::memory::Buffer buffer{1024, osmium::memory::Buffer::auto_grow::yes};
+
+    // More objects than the limit below which radix sort falls back to
+    // std::stable_sort (256).
+    add_random_objects(&buffer, 3000, 100);
+
+    object_ptr_vector objects;
+    add_objects(buffer, &objects);
+    REQUIRE(objects.size() == 3000);
+
+    const auto has_negative_id = std::any_of(objects.cbegin(), objects.cend(), [](const osmium::OSMObject* object) {
+        return object->id() < 0;
+    });
+    REQUIRE(has_negative_id);
+
+    const auto expected = reference_sort(objects);
+
+    auto sorted = objects;
+    sort_objects(&sorted, 1, sort_method::radix);
+    REQUIRE(std::is_sorted(sorted.cbegin(), sorted.cend(), osmium::object_order_type_id_version{}));
+    REQUIRE(equal_objects_in_input_order(sorted));
+    REQUIRE(sorted == expected);
+
+    // zero and negative IDs come before positive IDs
+    const auto first_node = std::find_if(sorted.cbegin(), sorted.cend(), [](const osmium::OSMObject* object) {
+        return object->type() == osmium::item_type::node;
+    });
+    REQUIRE(first_node != sorted.cend());
+    REQUIRE((*first_node)->id() <= 0);
+}
+
+TEST_CASE("Sorting objects in parallel gives same result as single-threaded sort") {
+    osmium::memory::Buffer buffer{1024, osmium::memory::Buffer::auto_grow::yes};
+
+    // Enough objects to get several parts sorted in parallel, the limit
+    // is 10000 objects per thread.
+    add_random_objects(&buffer, 45000, 2000);
+
+    object_ptr_vector objects;
+    add_objects(buffer, &objects);
+    REQUIRE(objects.size() == 45000);
+
+    const auto expected = reference_sort(objects);
+    REQUIRE(equal_objects_in_input_order(expected));
+
+    for (const auto method : {sort_method::compare, sort_method::radix}) {
+        for (const unsigned int num_threads : {1U, 3U, 4U}) {
+            auto sorted = objects;
+            sort_objects(&sorted, num_threads, method);
+            REQUIRE(sorted == expected);
+        }
+    }
+}
+
+TEST_CASE("Merging sorted parts gives same result as sorting everything") {
+    osmium::memory::Buffer buffer{1024, osmium::memory::Buffer::auto_grow::yes};
+    add_random_objects(&buffer, 5000, 300);
+
+    object_ptr_vector objects;
+    add_objects(buffer, &objects);
+    const auto expected = reference_sort(objects);
+
+    // five parts, so there is an odd number of parts to merge
+    const std::vector<std::size_t> bounds = {0, 700, 2000, 2001, 4500, objects.size()};
+    for (std::size_t n = 0; n + 1 < bounds.size(); ++n) {
+        std::stable_sort(objects.begin() + static_cast<std::ptrdiff_t>(bounds[n]),
+                         objects.begin() + static_cast<std::ptrdiff_t>(bounds[n + 1]),
+                         osmium::object_order_type_id_version{});
+    }
+
+    for (const unsigned int num_threads : {1U, 4U}) {
+        auto merged = objects;
+        merge_sorted_parts(&merged, bounds, num_threads);
+        REQUIRE(merged == expected);
+    }
+}
+
+TEST_CASE("Merging many sorted runs in several rounds gives same result as sorting everything") {
+    osmium::memory::Buffer buffer{1024, osmium::memory::Buffer::auto_grow::yes};
+    add_random_objects(&buffer, 13000, 1000);
+
+    object_ptr_vector objects;
+    add_objects(buffer, &objects);
+
+    using key_type = std::tuple<osmium::item_type, osmium::object_id_type, osmium::object_version_type, osmium::changeset_id_type>;
+    const auto key = [](const osmium::OSMObject& object) {
+        return key_type{object.type(), object.id(), object.version(), object.changeset()};
+    };
+
+    std::vector<key_type> expected;
+    for (const auto* object : reference_sort(objects)) {
+        expected.push_back(key(*object));
+    }
+
+    // Tiny runs of 50 objects each, so there are more runs than can be
+    // merged in one go and they have to be merged in two rounds.
+    constexpr const std::size_t run_size = 50;
+    constexpr const std::size_t max_fan_in = 64;
+    std::vector<BufferSpool> runs;
+    for (std::size_t n = 0; n < objects.size(); n += run_size) {
+        object_ptr_vector run(objects.begin() + static_cast<std::ptrdiff_t>(n),
+                              objects.begin() + static_cast<std::ptrdiff_t>(std::min(n + run_size, objects.size())));
+        sort_objects(&run, 1);
+        runs.emplace_back(default_tmp_dir());
+        for (const auto* object : run) {
+            runs.back().add(*object);
+        }
+        runs.back().flush();
+    }
+    REQUIRE(runs.size() == 260);
+
+    osmium::VerboseOutput vout{false};
+    merge_runs(&runs, max_fan_in, default_tmp_dir(), vout);
+    REQUIRE(runs.size() == 5);
+
+    std::vector<SpoolSource> sources;
+    for (auto& run : runs) {
+        run.rewind();
+        sources.emplace_back(run);
+    }
+    std::vector<key_type> merged;
+    merge_sorted(sources, [&](const osmium::OSMObject& object) {
+        merged.push_back(key(object));
+    });
+
+    REQUIRE(merged == expected);
+}
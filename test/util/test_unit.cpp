@@ -1,10 +1,16 @@
 
 #include "test.hpp" // IWYU pragma: keep
 
+#include "pbf_blob_reader.hpp"
 #include "util.hpp"
 
+#include <osmium/io/error.hpp>
 #include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/item_type.hpp>
+#include <osmium/osm/object.hpp>
 
+#include <cstddef>
+#include <cstdint>
 #include <sstream>
 #include <string>
 
@@ -144,3 +150,47 @@ TEST_CASE("ends_with") {
     REQUIRE(ends_with("file.osm.bz2", ".bz2"));
     REQUIRE(ends_with("file.osm.bz2", ".osm.bz2"));
 }
+
+TEST_CASE("Read blobs from PBF file") {
+    PbfBlobReader reader{"test/formats/f1.osm.pbf"};
+
+    pbf_blob blob;
+    REQUIRE(reader.next(&blob));
+    REQUIRE(blob.type == "OSMHeader");
+    REQUIRE(blob.offset == 0);
+
+    std::size_t nodes = 0;
+    std::size_t ways = 0;
+    std::size_t relations = 0;
+    std::uint64_t end = blob.end_offset();
+    while (reader.next(&blob)) {
+        REQUIRE(blob.type == "OSMData");
+        REQUIRE(blob.offset == end);
+        end = blob.end_offset();
+        const auto buffer = decode_pbf_data_blob(reader.read_data(blob), osmium::osm_entity_bits::nwr);
+        for (const auto& object : buffer.select<osmium::OSMObject>()) {
+            switch (object.type()) {
+                case osmium::item_type::node:
+                    ++nodes;
+                    break;
+                case osmium::item_type::way:
+                    ++ways;
+                    break;
+                default:
+                    ++relations;
+            }
+        }
+    }
+
+    REQUIRE(end == reader.file_size());
+    REQUIRE(nodes == 4);
+    REQUIRE(ways == 2);
+    REQUIRE(relations == 1);
+}
+
+TEST_CASE("Reading blobs from non-PBF file fails") {
+    PbfBlobReader reader{"test/formats/f1.osm"};
+
+    pbf_blob blob;
+    REQUIRE_THROWS_AS(reader.next(&blob), osmium::pbf_error);
+}